@@ -0,0 +1,42 @@
+#pragma once
+
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <string>
+
+#include "types.h"
+
+// One measurement, printed as a CSV line so that results can be tracked over time
+struct bench_result {
+	std::string suite;
+	std::string name;
+	std::string params;
+	Int operations;
+	double seconds;
+};
+
+inline void print_header() {
+	std::printf("suite,name,params,operations,seconds,operations_per_second\n");
+}
+
+inline void print_result(const bench_result& r) {
+	double rate { r.seconds > 0. ? r.operations / r.seconds : 0. };
+	std::printf("%s,%s,%s,%" PRIu64 ",%.6f,%.1f\n", r.suite.c_str(), r.name.c_str(), r.params.c_str(), r.operations, r.seconds, rate);
+	std::fflush(stdout);
+}
+
+// Wall-clock duration of f() in seconds
+template<typename F>
+double time_it(F&& f) {
+	auto start { std::chrono::steady_clock::now() };
+	f();
+	std::chrono::duration<double> elapsed { std::chrono::steady_clock::now() - start };
+	return elapsed.count();
+}
+
+// Prevent the compiler from discarding a computation whose result is unused
+inline volatile Int bench_sink;
+inline void do_not_optimize(Int value) {
+	bench_sink = bench_sink + value;
+}
@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "generator/generator.h"
+#include "generator/generator_info.h"
+#include "image/image.h"
+#include "types.h"
+
+// Streams of the reference image and of the measured renders, distinct so that their noises are independent
+constexpr Int reference_stream { 0x5eed };
+constexpr Int render_stream    { 0xbeef };
+
+struct render_result {
+	double seconds;
+	std::vector<Int> counters;
+	generator_stats stats;
+};
+
+// Measured sampler, the Monte Carlo one with either one tree learnt by all threads or one tree per thread
+struct sampler_config {
+	std::string name;
+	sampler_type sampler_t;
+	bool shared_tree { true };
+};
+
+// Render `seeds` seeds of a small, fast scene from scratch, and return the histogram
+render_result render(uint16_t size, const sampler_config& sampler, Int stream, Int seeds, uint32_t threads_number) {
+	using namespace std::chrono_literals;
+
+	generator_properties properties;
+	properties.image_width = size;
+	properties.image_height = size;
+	properties.sampler_t = sampler.sampler_t;
+	properties.shared_tree = sampler.shared_tree;
+	properties.rng_stream = stream;
+	generator_parameters parameters;
+	parameters.iterations_to_escape = 1000;
+	parameters.minimum_iterations = 20;
+	generator_runtime_parameters runtime_parameters;
+	runtime_parameters.threads_number = threads_number;
+	runtime_parameters.pool_batch_size = 0;
+	runtime_parameters.thread_batch_size = std::max<Int>(1, seeds / (threads_number * 16));
+	runtime_parameters.points_target = seeds;
+
+	auto image_ptr { std::make_shared<image>(size, size) };
+	generator gen(image_ptr, properties, parameters, runtime_parameters);
+
+	auto start { std::chrono::steady_clock::now() };
+	gen.resume();
+	while (gen.total_progress().first < seeds)
+		std::this_thread::sleep_for(1ms);
+	std::chrono::duration<double> elapsed { std::chrono::steady_clock::now() - start };
+	gen.stop();
+
+	render_result res { elapsed.count(), std::vector<Int>(static_cast<size_t>(size) * size), gen.stats() };
+	for (uint16_t y { 0 } ; y < size ; y++)
+		for (uint16_t x { 0 } ; x < size ; x++)
+			res.counters[x + static_cast<size_t>(size) * y] = image_ptr->read(x, y);
+	return res;
+}
+
+// RMS difference of the normalized histograms, relative to the mean normalized pixel
+double relative_rmse(const std::vector<Int>& counters, const std::vector<Int>& reference) {
+	double sum { 0. }, reference_sum { 0. };
+	for (size_t i { 0 } ; i < counters.size() ; i++) {
+		sum += counters[i];
+		reference_sum += reference[i];
+	}
+	if (sum == 0. || reference_sum == 0.)
+		return 1.;
+
+	double squares { 0. };
+	for (size_t i { 0 } ; i < counters.size() ; i++) {
+		double d { counters[i] / sum - reference[i] / reference_sum };
+		squares += d * d;
+	}
+	return std::sqrt(squares / counters.size()) * counters.size();
+}
+
+// Usage: buddhabrot-convergence [--size N] [--seeds N] [--reference-scale F] [--target-noise E] [--threads N] [samplers...]
+// Renders with 1/64, 1/32, ... 1 times --seeds seeds with each sampler, and prints as CSV the error against a reference
+// image rendered with --reference-scale times more uniform seeds, and the points in view per seed, which shows how fast
+// the Monte Carlo trees learn. A second table gives the time to reach --target-noise.
+// The error cannot go below the noise of the reference itself.
+int main(int argc, char** argv) {
+	uint16_t size { 256 };
+	Int seeds { 4000000 };
+	double reference_scale { 16. };
+	double target_noise { 0.05 };
+	uint32_t threads_number { std::max(1u, std::thread::hardware_concurrency()) };
+	std::vector<std::string> selected;
+	for (int i { 1 } ; i < argc ; i++) {
+		if (std::strcmp(argv[i], "--size") == 0 && i + 1 < argc)
+			size = std::atoi(argv[++i]);
+		else if (std::strcmp(argv[i], "--seeds") == 0 && i + 1 < argc)
+			seeds = std::strtoull(argv[++i], nullptr, 10);
+		else if (std::strcmp(argv[i], "--reference-scale") == 0 && i + 1 < argc)
+			reference_scale = std::atof(argv[++i]);
+		else if (std::strcmp(argv[i], "--target-noise") == 0 && i + 1 < argc)
+			target_noise = std::atof(argv[++i]);
+		else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			threads_number = std::max(1, std::atoi(argv[++i]));
+		else
+			selected.emplace_back(argv[i]);
+	}
+
+	render_result reference { render(size, { "Uniform", sampler_type::Uniform }, reference_stream, static_cast<Int>(seeds * reference_scale), threads_number) };
+
+	struct time_to_target {
+		std::string sampler;
+		Int seeds { 0 };
+		double seconds { 0. };
+	};
+	std::vector<time_to_target> targets;
+
+	std::vector<sampler_config> samplers;
+	for (sampler_type s : { sampler_type::Uniform, sampler_type::MonteCarlo, sampler_type::Sobol, sampler_type::Halton, sampler_type::R2, sampler_type::ImportanceMap })
+		samplers.push_back({ std::string(sampler_to_string(s)), s });
+	samplers.push_back({ "Monte Carlo (tree per thread)", sampler_type::MonteCarlo, false });
+
+	std::printf("sampler,seeds,seconds,relative_rmse,view_points_per_seed\n");
+	for (auto& s : samplers) {
+		const std::string& name { s.name };
+		if (!selected.empty() && std::find(selected.begin(), selected.end(), name) == selected.end())
+			continue;
+
+		time_to_target target { name };
+		for (Int n { std::max<Int>(1, seeds / 64) } ; n <= seeds ; n *= 2) {
+			render_result r { render(size, s, render_stream, n, threads_number) };
+			double error { relative_rmse(r.counters, reference.counters) };
+			double yield { static_cast<double>(r.stats.points_in_view) / std::max<Int>(1, r.stats.seeds) };
+			std::printf("%s,%" PRIu64 ",%.3f,%.5f,%.2f\n", name.c_str(), n, r.seconds, error, yield);
+			std::fflush(stdout);
+			if (target.seeds == 0 && error <= target_noise)
+				target = { name, n, r.seconds };
+		}
+		targets.push_back(target);
+	}
+
+	std::printf("\nsampler,target_noise,seeds_to_target,seconds_to_target\n");
+	for (auto& t : targets) {
+		if (t.seeds == 0)
+			std::printf("%s,%.5f,,\n", t.sampler.c_str(), target_noise);
+		else
+			std::printf("%s,%.5f,%" PRIu64 ",%.3f\n", t.sampler.c_str(), target_noise, t.seeds, t.seconds);
+	}
+	return 0;
+}
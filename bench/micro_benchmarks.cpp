@@ -0,0 +1,179 @@
+#include <algorithm>
+#include <complex>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bench_helper.h"
+#include "generator/generator_info.h"
+#include "generator/seed_block.h"
+#include "image/image.h"
+#include "mandelbrot_helper.h"
+#include "sampler/index_sampler.h"
+#include "sampler/monte_carlo_sampler.h"
+#include "sampler/qmc_sampler.h"
+#include "sampler/uniform_sampler.h"
+#include "types.h"
+
+// Every benchmark draws its inputs from engines seeded with this value, so two runs measure the same work
+constexpr Int bench_seed { 0x5eed };
+
+// Seeds outside of the cardioids, drawn uniformly over the default view
+std::vector<std::complex<Real>> make_seeds(Int count) {
+	generator_properties properties;
+	uniform_sampler sampler(properties.corner_a, properties.corner_b, bench_seed);
+	std::vector<std::complex<Real>> seeds;
+	seeds.reserve(count);
+	while (seeds.size() < count) {
+		std::complex<Real> z0 { sampler.sample(seeds.size()).sample };
+		if (!insideCardioids(z0))
+			seeds.push_back(z0);
+	}
+	return seeds;
+}
+
+// Escape iteration of the kernel, per seed, for several iteration limits
+void bench_escape() {
+	generator_parameters parameters;
+	for (Int limit : { 100, 1000, 10000, 100000, 1000000 }) {
+		// keep the total amount of work roughly constant across limits
+		Int count { std::max<Int>(64, 20000000 / limit) };
+		std::vector<std::complex<Real>> seeds { make_seeds(count) };
+
+		Int iterations { 0 };
+		double seconds { time_it([&]{
+			for (auto& z0 : seeds)
+				iterations += escape_iterations(z0, limit, parameters.escape_norm);
+		}) };
+		do_not_optimize(iterations);
+
+		std::string params { "iterations_to_escape=" + std::to_string(limit) };
+		print_result({ "escape", "seeds", params, count, seconds });
+		print_result({ "escape", "iterations", params, iterations, seconds });
+	}
+}
+
+// Draws per second of each sampler, feedback included since it is part of the generator's hot path
+template<typename sampler_t>
+double run_sampler(sampler_t& sampler, Int draws) {
+	return time_it([&]{
+		Int checksum { 0 };
+		for (Int i { 0 } ; i < draws ; i++) {
+			sample_result sample { sampler.sample(i) };
+			// deterministic feedback: one sample out of seven contributes to the image
+			sample.feedback_result(i % 7 == 0 ? 10 : 0, 1000);
+			checksum += static_cast<Int>(sample.sample.real() * 1e6);
+		}
+		do_not_optimize(checksum);
+	});
+}
+
+void bench_sampler() {
+	generator_properties properties;
+	constexpr Int draws { 200000 };
+
+	{
+		uniform_sampler sampler(properties.corner_a, properties.corner_b, bench_seed);
+		print_result({ "sampler", "uniform", "", draws, run_sampler(sampler, draws) });
+	}
+	for (auto [name, sequence] : { std::pair{ "sobol", qmc_sequence::Sobol }, std::pair{ "halton", qmc_sequence::Halton }, std::pair{ "r2", qmc_sequence::R2 } }) {
+		qmc_sampler sampler(properties.corner_a, properties.corner_b, sequence, bench_seed);
+		print_result({ "sampler", name, "", draws, run_sampler(sampler, draws) });
+	}
+
+	std::pair<Int, Int> configurations[] { { 1, 8 }, { 2, 4 }, { 2, 8 }, { 2, 16 }, { 3, 4 }, { 3, 8 }, { 4, 8 }, { 6, 8 } };
+	for (auto [layers, layer_resolution] : configurations) {
+		std::string params { "layers=" + std::to_string(layers) + " layer_resolution=" + std::to_string(layer_resolution) };
+
+		std::unique_ptr<monte_carlo_sampler> sampler;
+		double build_seconds { time_it([&]{
+			sampler = std::make_unique<monte_carlo_sampler>(properties.corner_a, properties.corner_b, layers, layer_resolution, generator_properties().tree_max_nodes, bench_seed);
+		}) };
+		print_result({ "sampler", "monte_carlo_construction", params, 1, build_seconds });
+		print_result({ "sampler", "monte_carlo", params, draws, run_sampler(*sampler, draws) });
+		std::clog << params << ": " << sampler->tree->nodes() << " tree nodes after " << draws << " draws\n";
+	}
+}
+
+// Seeds per second through the bounded-orbit tests, one by one as the worker loop used to, and by seed blocks, which
+// also reject the seeds of more bulbs. Seeds are drawn by the cheapest sampler, so that the tests dominate
+void bench_prefilter() {
+	generator_properties properties;
+	constexpr Int draws { 4000000 };
+	{
+		index_sampler sampler(properties.seed_corner_a, properties.seed_corner_b, bench_seed);
+		Int rejected { 0 };
+		double seconds { time_it([&]{
+			for (Int i { 0 } ; i < draws ; i++)
+				rejected += insideCardioids(sampler.sample(i).sample);
+		}) };
+		do_not_optimize(rejected);
+		print_result({ "prefilter", "scalar_cardioids", "rejected=" + std::to_string(rejected), draws, seconds });
+	}
+	{
+		index_sampler sampler(properties.seed_corner_a, properties.seed_corner_b, bench_seed);
+		seed_block block;
+		Int rejected { 0 };
+		double seconds { time_it([&]{
+			for (Int first { 0 } ; first < draws ; first += seed_block::capacity) {
+				block.fill(sampler, { first, std::min<Int>(draws, first + seed_block::capacity) });
+				Int index, skipped;
+				sample_result sample;
+				while (block.next(0, index, sample, skipped))
+					rejected += skipped;
+				rejected += skipped;
+			}
+		}) };
+		do_not_optimize(rejected);
+		print_result({ "prefilter", "seed_blocks", "rejected=" + std::to_string(rejected), draws, seconds });
+	}
+}
+
+// Increments per second of each histogram backend, with pixels drawn uniformly over the image
+void bench_scatter() {
+	constexpr Int increments { 20000000 };
+	for (uint16_t size : { 720, 2048, 4096 }) {
+		std::mt19937_64 engine(bench_seed);
+		std::uniform_int_distribution<uint16_t> distrib(0, size - 1);
+		std::vector<std::pair<uint16_t, uint16_t>> pixels(1 << 20);
+		for (auto& p : pixels)
+			p = { distrib(engine), distrib(engine) };
+
+		std::string params { "size=" + std::to_string(size) + "x" + std::to_string(size) };
+
+		image img(size, size);
+		double seconds { time_it([&]{
+			for (Int i { 0 } ; i < increments ; i++) {
+				auto [x, y] = pixels[i & (pixels.size() - 1)];
+				img.incr(x, y);
+			}
+		}) };
+		do_not_optimize(img.read(0, 0));
+		print_result({ "scatter", "image", params, increments, seconds });
+	}
+}
+
+// Usage: buddhabrot-bench [escape] [sampler] [prefilter] [scatter]
+// Without argument, every suite is run. Results are printed as CSV on the standard output.
+int main(int argc, char** argv) {
+	auto selected = [&](const char* suite){
+		if (argc <= 1)
+			return true;
+		for (int i { 1 } ; i < argc ; i++)
+			if (std::strcmp(argv[i], suite) == 0)
+				return true;
+		return false;
+	};
+
+	print_header();
+	if (selected("escape"))  bench_escape();
+	if (selected("sampler")) bench_sampler();
+	if (selected("prefilter")) bench_prefilter();
+	if (selected("scatter")) bench_scatter();
+
+	return 0;
+}
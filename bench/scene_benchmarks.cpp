@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <chrono>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "generator/generator.h"
+#include "generator/generator_info.h"
+#include "image/image.h"
+#include "types.h"
+
+using namespace std::complex_literals;
+
+// A canonical render: the real generator is run on it until `seeds` candidates have been processed
+struct scene {
+	std::string name;
+	generator_properties properties;
+	generator_parameters parameters;
+	Int seeds;
+};
+
+std::vector<scene> make_scenes(double seeds_scale) {
+	std::vector<scene> scenes;
+	auto add = [&](std::string name, Int seeds, auto customize) {
+		scene s { name, generator_properties(), generator_parameters(), static_cast<Int>(seeds * seeds_scale) };
+		customize(s);
+		scenes.push_back(s);
+	};
+
+	add("default-720", 20000, [](scene&){});
+	add("poster-4096", 20000, [](scene& s){
+		s.properties.image_width = 4096;
+		s.properties.image_height = 4096;
+	});
+	add("zoom-720", 20000, [](scene& s){
+		s.properties.corner_a = -0.85 + 0.05i;
+		s.properties.corner_b = -0.65 + 0.25i;
+	});
+	add("low-iterations-720", 500000, [](scene& s){
+		s.parameters.iterations_to_escape = 1000;
+		s.parameters.minimum_iterations = 20;
+	});
+	add("high-iterations-720", 2000, [](scene& s){
+		s.parameters.iterations_to_escape = 10000000;
+		s.parameters.minimum_iterations = 1000000;
+	});
+	return scenes;
+}
+
+struct scene_result {
+	double seconds;
+	generator_stats stats;
+};
+
+scene_result run_scene(scene& s, uint32_t threads_number) {
+	using namespace std::chrono_literals;
+
+	generator_runtime_parameters runtime_parameters;
+	runtime_parameters.threads_number = threads_number;
+	runtime_parameters.pool_batch_size = 0;
+	runtime_parameters.thread_batch_size = std::max<Int>(1, s.seeds / (threads_number * 16));
+	runtime_parameters.points_target = s.seeds;
+
+	auto image_ptr { std::make_shared<image>(s.properties.image_width, s.properties.image_height) };
+	generator gen(image_ptr, s.properties, s.parameters, runtime_parameters);
+
+	auto start { std::chrono::steady_clock::now() };
+	gen.resume();
+	while (gen.total_progress().first < s.seeds)
+		std::this_thread::sleep_for(1ms);
+	std::chrono::duration<double> elapsed { std::chrono::steady_clock::now() - start };
+	gen.stop();
+
+	return { elapsed.count(), gen.stats() };
+}
+
+// Usage: buddhabrot-scenes [--threads N] [--seeds-scale F] [scene names...]
+// Runs each scene with 1, 2, 4, ... N threads and prints a strong-scaling table as CSV on the standard output.
+int main(int argc, char** argv) {
+	uint32_t max_threads { std::max(1u, std::thread::hardware_concurrency()) };
+	double seeds_scale { 1. };
+	std::vector<std::string> selected;
+	for (int i { 1 } ; i < argc ; i++) {
+		if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+			max_threads = std::max(1, std::atoi(argv[++i]));
+		else if (std::strcmp(argv[i], "--seeds-scale") == 0 && i + 1 < argc)
+			seeds_scale = std::atof(argv[++i]);
+		else
+			selected.emplace_back(argv[i]);
+	}
+
+	std::vector<uint32_t> thread_counts;
+	for (uint32_t t { 1 } ; t < max_threads ; t *= 2)
+		thread_counts.push_back(t);
+	thread_counts.push_back(max_threads);
+
+	std::printf("scene,threads,seeds,seconds,seeds_per_second,orbit_points_per_second,accepted_ratio,speedup,efficiency\n");
+	for (auto& s : make_scenes(seeds_scale)) {
+		if (!selected.empty() && std::find(selected.begin(), selected.end(), s.name) == selected.end())
+			continue;
+
+		double reference_seconds { 0. };
+		for (uint32_t threads : thread_counts) {
+			scene_result r { run_scene(s, threads) };
+			if (threads == 1)
+				reference_seconds = r.seconds;
+
+			double seeds_rate { r.stats.seeds / r.seconds };
+			double points_rate { r.stats.orbit_points / r.seconds };
+			double accepted_ratio { r.stats.seeds ? static_cast<double>(r.stats.accepted_orbits) / r.stats.seeds : 0. };
+			double speedup { reference_seconds / r.seconds };
+			std::printf("%s,%u,%" PRIu64 ",%.3f,%.1f,%.1f,%.6f,%.2f,%.2f\n",
+				s.name.c_str(), threads, r.stats.seeds, r.seconds, seeds_rate, points_rate, accepted_ratio, speedup, speedup / threads);
+			std::fflush(stdout);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "generator/generator_info.h"
+#include "types.h"
+
+// Message sent by a worker process to the coordinator, answered by a budget_grant
+struct worker_report {
+	Int seeds_done { 0 };     // seeds processed by the worker since it started
+	generator_stats stats;    // cumulative counters of the worker
+	bool wants_budget { true };
+	bool final { false };     // the worker has finished and is about to exit
+};
+
+struct budget_grant {
+	Int seeds { 0 };          // additional seeds the worker may process, 0 when the render is over
+	bool stop { false };      // the render reached a target, the worker leaves the seeds it was granted
+};
+
+// Hands out seed budgets to local worker processes over a Unix socket, and aggregates their reports
+class coordinator {
+public:
+	~coordinator();
+
+	bool listen(const std::string& socket_path);
+	// points_target == 0 means that there is no limit of seeds, workers then run until stop() is called
+	void set_target(Int points_target, Int chunk);
+	// no more seeds are granted, and with at_once the workers leave the seeds they were granted
+	void stop(bool at_once = false);
+
+	// serve the workers until `expected_workers` have connected and all of them have disconnected,
+	// calling on_tick about every tick_seconds. Serving is abandoned if on_tick returns false
+	void serve(size_t expected_workers, const std::function<bool()>& on_tick, double tick_seconds);
+
+	generator_stats stats() const;
+	Int seeds_done() const;
+private:
+	struct client {
+		int fd;
+		Int granted { 0 };
+		worker_report last_report {};
+	};
+
+	bool handle(client& c);
+	void disconnect(client& c);
+
+	std::string socket_path;
+	int listen_fd { -1 };
+	std::vector<client> clients;
+	size_t connected { 0 };
+
+	Int points_target { 0 };
+	Int chunk { 0 };
+	Int granted { 0 };
+	bool stopping { false };
+	bool stopping_at_once { false };
+
+	// reports of the workers already disconnected
+	generator_stats retired_stats;
+	Int retired_seeds_done { 0 };
+};
+
+// Connection of a worker process to its coordinator
+class coordinator_client {
+public:
+	~coordinator_client();
+
+	bool connect(const std::string& socket_path);
+	// report the progress and get a new budget, of 0 seeds when the render is over or the coordinator is gone
+	budget_grant request(const worker_report& report);
+private:
+	int fd { -1 };
+};
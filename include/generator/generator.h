@@ -1,6 +1,8 @@
 #pragma once
 
+#include <atomic>
 #include <complex>
+#include <condition_variable>
 #include <cstdint>
 #include <thread>
 #include <memory>
@@ -9,8 +11,18 @@
 
 #include "image/abstract_image.h"
 #include "generator/generator_info.h"
+#include "generator/pixel_queue.h"
+#include "generator/scheduler.h"
+#include "generator/topology.h"
+#include "image/image.h"
+#include "sampler/sampler.h"
 #include "types.h"
 
+class importance_map;
+class metropolis_sampler;
+class monte_carlo_tree;
+class seed_cache_writer;
+
 using namespace std::complex_literals;
 
 class generator {
@@ -19,7 +31,16 @@ public:
 	~generator();
 
 	void set_parameters(generator_parameters& parameters);
+	// can be changed while running: the workers are added or retired, and the batch sizes changed, without a restart
 	void set_runtime_parameters(generator_runtime_parameters& runtime_parameters);
+	void set_points_target(Int points_target); // can be changed while running, and until a target is reached
+	// end the render once the seeds already handed out to the workers are processed, so that a deterministic render
+	// covers a contiguous range of seeds and can be continued from the next one
+	void finish_handed_out_seeds();
+
+	// append the accepted seeds to a cache, to be replayed later with other parameters. Not while running, and only
+	// while stopped to replace a recorder. Not for Metropolis-Hastings, whose orbits are weighted
+	void set_seed_recorder(std::shared_ptr<seed_cache_writer> recorder);
 	void initiate();
 	void resume();
 	void pause();
@@ -30,12 +51,97 @@ public:
 	std::vector<std::pair<Int, Int>> progress();
 	std::pair<Int, Int> pool_progress();
 	std::pair<Int, Int> total_progress();
+	generator_stats stats();
+	std::vector<generator_stats> node_stats(); // empty if the threads are not pinned
+	// target which ended the render, None while it goes on. The workers then give their threads back to the pool,
+	// but the generator still has to be stopped
+	render_target reached_target() const { return m_reached_target.load(std::memory_order_relaxed); }
+	Real noise_estimate() const { return m_noise_estimate.load(std::memory_order_relaxed); } // 0 until estimated
+	Int running_ms() const; // pauses excluded
+	// seeds of an earlier render already accumulated in the image, which the noise estimate accounts for
+	void set_seeds_in_image(Int seeds) { seeds_in_image = seeds; }
+	void merge_replicas(); // make the per-node images' content visible in the image
 private:
+	// Counters written by a single worker and read by any thread
+	struct thread_counters {
+		std::atomic<Int> seeds                 { 0 };
+		std::atomic<Int> cardioid_rejects      { 0 };
+		std::atomic<Int> non_escaping_rejects  { 0 };
+		std::atomic<Int> below_minimum_rejects { 0 };
+		std::atomic<Int> accepted_orbits       { 0 };
+		std::atomic<Int> missed_view_orbits    { 0 };
+		std::atomic<Int> orbit_points          { 0 };
+		std::atomic<Int> points_in_view        { 0 };
+		std::atomic<Int> lock_wait_ns          { 0 };
+
+		// only the owning thread may call add, so a relaxed load and store are enough
+		static void add(std::atomic<Int>& counter, Int value) {
+			counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+		}
+		generator_stats load() const;
+		void reset(); // only while the owning thread does not run
+	};
+
+	// Sampler, buffers and seeds of a worker, kept between the jobs which run it
+	struct worker_context;
+
+	// Everything a worker writes for every seed, on its own cache lines so that workers do not false-share
+	struct alignas(cache_line_size) thread_state {
+		std::atomic<Int> points_done { 0 }; // seeds processed in the current batch
+		std::atomic<Int> batch_size  { 0 };
+		thread_counters counters;
+
+		bool pinned { false };
+		uint32_t cpu { 0 };
+		size_t node { 0 };
+
+		std::unique_ptr<worker_context> context;
+		bool running { false }; // a job of the pool runs the worker, guarded by workers_mutex
+	};
+
+	// Copy of the image allocated on a NUMA node, for the threads of this node
+	struct image_replica {
+		std::mutex mutex;
+		std::unique_ptr<image> img;
+	};
+
+	// Rows of the histogram accumulated by a scatter thread, from the pixels queued by every iteration thread
+	struct scatter_band {
+		uint16_t first_row, end_row;
+		std::vector<std::unique_ptr<pixel_queue>> queues; // one per iteration thread
+		bool running { false }; // guarded by workers_mutex
+	};
+
+	void allocate_replicas();
+	void allocate_bands(size_t count);
+	std::unique_ptr<sampler> make_sampler(Int sampler_seed) const;
+
+	using pixel_list = std::vector<std::pair<uint16_t, uint16_t>>;
+	void metropolis_step(metropolis_sampler& chain, thread_counters& counters, abstractImage& target_image, std::mutex& target_image_mutex,
+	                     pixel_list& current_pixels, pixel_list& proposal_pixels);
+
+	// jobs submitted to the thread pool, which run their worker until it is paused or stopped
 	void task(size_t thread_index);
-	void join_all_threads_and_clear();
+	void scatter_task(size_t band_index);
+	void start_jobs(); // with workers_mutex owned
+	bool leave_job(thread_state& state); // false if the generator was resumed meanwhile
+	void retire_workers(); // wait for the jobs, then give back the workers' seeds and clear them
+	void retire_worker(size_t thread_index);
+	void retire_counters(thread_state& state);
+	void configure_workers();
+
+	// checked by the workers between two batches, ends the render when a target is reached
+	void check_targets();
+	Int running_ns() const;
+	bool noise_below_target();
 
-	Int request_batch(size_t thread_index);
-	void save_progress(size_t thread_index, Int& batch_done, Int& batch_target);
+	Int next_batch_size(Int batch_size, Int batch_done, double batch_seconds);
+	void save_progress(size_t thread_index, Int& batch_done);
+
+	// the shared tree is saved in the cache directory when the generator stops, and warm-starts the next one
+	std::string tree_cache_path() const;
+	std::shared_ptr<monte_carlo_tree> make_shared_tree() const;
+	void save_shared_tree() const;
 
 	std::mutex image_ptr_mutex;
 	std::shared_ptr<abstractImage> image_ptr;
@@ -47,13 +153,39 @@ public:
 private:
 	// runtime data
 	status m_status;
-	order m_order;
-	std::vector<std::thread> threads;
-
-	std::mutex sample_mutex; // lock any access to the sampler
-	std::mutex access_progress_mutex; // lock any access to the batch size of each thread and the total progress i.e when requesting a batch or saving progress
-	std::vector<Int> threads_points_done;
-	std::vector<Int> threads_batch_size;
-	Int pool_points_done;
-	Int total_points_done;
+	std::atomic<order> m_order;
+	// jobs running the workers and the scatter bands. A job leaves when the generator is paused or stopped, so that
+	// no thread of the pool is held by a paused generator
+	std::mutex workers_mutex;
+	std::condition_variable workers_done;
+	size_t active_workers { 0 };
+	size_t active_scatters { 0 };
+
+	std::atomic<render_target> m_reached_target { render_target::None };
+	std::atomic<Int> points_target_at_target { 0 }; // seeds handed out when the target was reached, 0 before
+	std::atomic<Int> run_ns_before_resume { 0 };
+	std::atomic<Int> resumed_at_ns { 0 };
+	// normalized image of an earlier snapshot, for the noise estimate
+	std::mutex noise_mutex;
+	std::vector<float> noise_snapshot;
+	Int noise_snapshot_seeds { 0 };
+	Int seeds_in_image { 0 };
+	std::atomic<Real> m_noise_estimate { 0. };
+
+	scheduler work_scheduler;
+	// only created and cleared by the thread controlling the generator, so reading it from this thread needs no lock
+	std::vector<std::unique_ptr<thread_state>> threads_state;
+	std::atomic<Int> total_points_done; // only accounts for the finished batches
+	generator_stats retired_stats; // counters of the workers already retired
+	std::vector<generator_stats> retired_node_stats;
+
+	Int spawned_threads; // to give a distinct seed to the sampler of each worker ever created
+	numa_topology topology;
+	std::vector<std::unique_ptr<image_replica>> replicas; // one per NUMA node when the threads are pinned on several nodes
+	std::vector<std::unique_ptr<scatter_band>> bands; // with scatter threads
+	std::vector<uint16_t> band_of_row;
+	std::shared_ptr<const importance_map> pilot_map; // of the current parameters, with the ImportanceMap sampler
+	std::shared_ptr<monte_carlo_tree> shared_tree; // learnt by the threads together, and kept when they are respawned
+	std::shared_ptr<seed_cache_writer> seed_recorder_owner;
+	std::atomic<seed_cache_writer*> seed_recorder { nullptr }; // read by the threads
 };
\ No newline at end of file
@@ -1,6 +1,10 @@
 #pragma once
 
 #include <complex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 #include "types.h"
 
@@ -9,21 +13,50 @@ using namespace std::complex_literals;
 
 enum class sampler_type {
 	Uniform,
-	MonteCarlo
+	MonteCarlo,
+	// quasi-Monte Carlo sequences, seeds derive from rng_stream and their index, so they are always deterministic
+	Sobol,
+	Halton,
+	R2,
+	// Metropolis-Hastings chains favouring the seeds whose orbits cross the view, for zooms
+	MetropolisHastings,
+	// seeds drawn from an importance map estimated by a pilot pass, deterministic like the QMC sequences
+	ImportanceMap
 };
 
 // Properties cannot be changed once the generator has been created
 struct generator_properties {
 	uint16_t image_width         { 720 };
 	uint16_t image_height        { 720 };
-	// ensure that corner_a < corner_b coordinate-wise
+	// rendered rectangle of the complex plane, ensure that corner_a < corner_b coordinate-wise
 	std::complex<Real> corner_a  { -2.25 - 1.5i };
 	std::complex<Real> corner_b  { +0.75 + 1.5i };
+	// rectangle the seeds are drawn from. Every orbit crossing the view starts in the |c| < 2 disk, so the default
+	// domain covers it whole: the useful seeds of a zoom mostly lie far from the view
+	std::complex<Real> seed_corner_a { -2. - 2.i };
+	std::complex<Real> seed_corner_b { +2. + 2.i };
 
 	sampler_type sampler_t       { sampler_type::MonteCarlo };
 	// MonteCarlo properties
 	Int layers                   { 2 };
 	Int layer_resolution         { 8 };
+	// cells are only split where samples are useful, so that deep trees stay small. Caps the nodes of each tree
+	Int tree_max_nodes           { 1 << 20 };
+	// one tree learnt by all the threads, instead of one per thread
+	bool shared_tree             { true };
+	// share of the counters kept when a tree is warm-started from the cache directory, 0 to always start afresh
+	Real tree_decay              { 0.8 };
+	// ImportanceMap properties: the pilot pass traces pilot_seeds seeds in each cell of a square grid
+	Int pilot_resolution         { 128 };
+	Int pilot_seeds              { 4 };
+
+	// the samplers' seeds derive from this stream, so renders with distinct streams never draw the same seeds.
+	// 0 draws a stream at random when the generator is created
+	Int rng_stream               { 0 };
+	// seeds only depend on rng_stream and on their index, instead of the samplers' state, so that the histogram is
+	// the same whatever the number of threads. The indices of the render start at first_seed_index
+	bool deterministic           { false };
+	Int first_seed_index         { 0 };
 };
 
 // Parameters control the behavior of sequences and can be changed
@@ -31,17 +64,55 @@ struct generator_parameters {
 	Int iterations_to_escape     { 1000000 };
 	Int minimum_iterations       { 100000  };
 	Real escape_norm             { 4.0 };
+	// every orbit also stands for its conjugate, the orbit of conj(c), which is plotted mirrored. When the seed domain
+	// is symmetric about the real axis, only its upper half is sampled, which halves the iterations for the same image
 	bool y_symetry               { false };
 };
 
+enum class thread_affinity {
+	None,		// let the system place the threads
+	Compact,	// fill the cores of a NUMA node before using the next one
+	Scatter,	// spread the threads over the NUMA nodes
+	CoreList	// use the cores of affinity_cores, in order
+};
+
 // Runtime parameters describe how to dispatch the computing of sequences
 struct generator_runtime_parameters {
 	uint32_t threads_number      { 4 };
 	Int pool_batch_size          { 100000 };
-	Int thread_batch_size        { pool_batch_size / threads_number };
+	Int thread_batch_size        { pool_batch_size / threads_number }; // size of the first batch of each thread
 	Int points_target            { 0 };
+	Int batch_duration_ms        { 250 }; // batch sizes adapt to last this long, 0 to always use thread_batch_size
+	// the render also ends as soon as one of these targets is reached, 0 disables each of them
+	Int time_budget_ms           { 0 }; // of running time, pauses excluded
+	Int accepted_orbits_target   { 0 };
+	Real noise_target            { 0. }; // estimated relative RMS noise of the image, e.g. 0.05
+	// threads applying the orbits to the histogram, each one to its own band of rows, so that the threads_number
+	// iteration threads only compute. 0 to let every thread scatter its own orbits. Metropolis-Hastings ignores it
+	uint32_t scatter_threads     { 0 };
+	thread_affinity affinity     { thread_affinity::None };
+	std::vector<uint32_t> affinity_cores;
+	std::string cache_directory; // where pilot passes and Monte Carlo trees are cached, empty to run them every time
+};
+
+// Counters of the work done by the generator
+struct generator_stats {
+	Int seeds                    { 0 }; // candidates drawn from the sampler
+	Int cardioid_rejects         { 0 }; // candidates inside the main cardioid or a bulb tested analytically
+	Int non_escaping_rejects     { 0 }; // candidates still bounded after iterations_to_escape
+	Int below_minimum_rejects    { 0 }; // candidates escaping before minimum_iterations
+	Int accepted_orbits          { 0 }; // orbits applied to the image
+	Int missed_view_orbits       { 0 }; // accepted orbits without any point in the image
+	Int orbit_points             { 0 }; // points of the accepted orbits
+	Int points_in_view           { 0 }; // points of the accepted orbits falling into the image
+	Int lock_wait_ns             { 0 }; // time spent by the threads waiting for the sampler and image locks, or for the scatter threads
+
+	generator_stats& operator+=(const generator_stats& other);
+	generator_stats& operator-=(const generator_stats& other);
 };
 
+std::string stats_to_string(const generator_stats& stats, double seconds);
+
 enum class status {
 	Running,
 	Stopping,
@@ -49,6 +120,14 @@ enum class status {
 	Stopped
 };
 
+// Target which ended a render, besides the points target
+enum class render_target {
+	None,
+	TimeBudget,
+	AcceptedOrbits,
+	Noise
+};
+
 enum class order {
 	Run,
 	Pause,
@@ -56,4 +135,13 @@ enum class order {
 	Stop
 };
 
-std::string_view status_to_string(status s);
\ No newline at end of file
+std::string_view status_to_string(status s);
+std::string_view affinity_to_string(thread_affinity a);
+std::string_view sampler_to_string(sampler_type s);
+std::string_view target_to_string(render_target t);
+
+// the seeds of these samplers only depend on their index, so their renders are always deterministic
+bool samples_by_index(sampler_type s);
+
+// Rectangle the samplers draw from: the seed domain, or its upper half when y_symetry makes the lower half redundant
+std::pair<std::complex<Real>, std::complex<Real>> sampled_seed_domain(const generator_properties& properties, const generator_parameters& parameters);
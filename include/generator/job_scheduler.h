@@ -0,0 +1,114 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "generator/generator.h"
+#include "generator/generator_info.h"
+#include "image/image.h"
+#include "types.h"
+
+// A render of the job queue, with its own histogram and targets
+struct job_description {
+	std::string name; // its state is saved as <name>.job and <name>.shard in the job directory
+	generator_properties properties;
+	generator_parameters parameters;
+	// the job is finished when one of them is reached, 0 disables each of them
+	Int points_target            { 0 };
+	Int time_budget_ms           { 0 };
+	Int accepted_orbits_target   { 0 };
+	Real noise_target            { 0. };
+	// jobs of a higher priority take every thread from those of a lower one, which are paused until they finish
+	Int priority                 { 0 };
+	// weight of the job when the threads are shared among the running jobs of the same priority
+	Real share                   { 1. };
+};
+
+enum class job_state {
+	Queued,    // never started by this process
+	Running,
+	Preempted, // paused, its threads were given to other jobs
+	Finished
+};
+
+std::string_view job_state_to_string(job_state s);
+
+// Progress of a job, as shown to the user
+struct job_info {
+	std::string name;
+	job_state state;
+	Int priority;
+	uint32_t threads;
+	generator_stats stats; // including the earlier processes
+	Int running_ms;
+	Real noise_estimate;
+	render_target reached;
+};
+
+// Shares the threads of the process among several renders, each one with its own generator. The jobs run on the
+// shared thread pool, and their threads are changed live with set_runtime_parameters, so that a job never restarts
+// when it is preempted or gets more threads. Every job is saved to the job directory, so that a queue interrupted
+// goes on where it stopped in the next process
+class job_scheduler {
+public:
+	// runtime_parameters are used by every job, threads_number being the threads shared by all of them
+	job_scheduler(const std::string& directory, const generator_runtime_parameters& runtime_parameters);
+	// saves the jobs. Deterministic ones first finish the seeds handed out, for a bounded time
+	~job_scheduler();
+
+	// add a job and save it, false if the name is taken or the job cannot be saved
+	bool submit(const job_description& job);
+	// add the jobs of the directory not known yet, such as those submitted by another process
+	void load();
+	// finish the jobs which reached their target, then share the threads among the others. Returns false once every
+	// job is finished
+	bool update();
+	// write the histogram and progress of every started job. Running deterministic jobs are written by the next updates,
+	// once the seeds handed out are done, and a failure to write them is returned by the next save
+	bool save();
+	void set_threads(uint32_t threads); // applied by the next update
+
+	std::vector<job_info> jobs();
+private:
+	struct job {
+		job_description description;
+		job_state state { job_state::Queued };
+		render_target reached { render_target::None };
+		// progress of the earlier processes, already in the histogram of the shard
+		Int running_ms_before { 0 };
+		generator_stats stats_before;
+		std::vector<Int> streams_before;
+		Int first_seed_index { 0 }; // of the whole render, when deterministic
+
+		std::shared_ptr<image> img;
+		std::unique_ptr<generator> gen;
+		uint32_t threads { 0 };
+		double thread_seconds { 0. }; // threads given to the job times the duration, for the fair shares
+		// a deterministic job being saved finishes the seeds handed out, then gets this points target back
+		bool draining { false };
+		Int points_target_after_drain { 0 };
+	};
+
+	std::string job_path(const job& j) const;
+	std::string shard_path(const job& j) const;
+	bool save_job(job& j);
+	bool load_job(const std::string& name);
+	void start(job& j);
+	bool finished(job& j);
+	void finish(job& j);
+	void start_drain(job& j);
+	bool end_drain(job& j, bool save); // false if the job could not be saved
+	// threads of each candidate, the least served ones first
+	std::vector<uint32_t> share_threads(std::vector<job*>& candidates);
+	generator_stats stats(const job& j) const;
+	Int running_ms(const job& j) const;
+
+	std::string directory;
+	generator_runtime_parameters runtime_parameters;
+	std::vector<std::unique_ptr<job>> queue;
+	bool drained_saves_ok { true }; // since the last save
+	std::chrono::steady_clock::time_point last_update;
+};
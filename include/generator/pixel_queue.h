@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "types.h"
+
+// Lock-free ring of blocks of histogram increments, from one iteration thread to one scatter thread. The producer
+// fills the block at the tail in place then publishes it, the consumer applies the block at the head then releases it,
+// so no entry is ever copied and neither side waits for the other unless the ring is full or empty
+class pixel_queue {
+public:
+	struct entry {
+		uint32_t offset; // of the pixel in the band of the scatter thread
+		uint32_t weight;
+	};
+	static constexpr size_t block_entries { 1024 };
+	struct block {
+		size_t size { 0 };
+		entry entries[block_entries];
+	};
+
+	explicit pixel_queue(size_t blocks);
+
+	// producer side: the block being filled, nullptr when every block waits for the consumer
+	block* writable();
+	void publish();
+	// consumer side: the oldest published block, nullptr when there is none
+	block* readable();
+	void release();
+private:
+	std::unique_ptr<block[]> blocks;
+	size_t capacity;
+	// positions only grow, the block of a position is position % capacity
+	alignas(cache_line_size) std::atomic<size_t> head { 0 }; // written by the consumer
+	alignas(cache_line_size) std::atomic<size_t> tail { 0 }; // written by the producer
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "types.h"
+
+// Half-open range [begin, end) of seed indices
+struct seed_range {
+	Int begin { 0 };
+	Int end   { 0 };
+
+	Int size() const { return end - begin; }
+	bool empty() const { return begin >= end; }
+};
+
+// Hands out disjoint ranges of seed indices to the workers.
+// Each worker pops indices from its own queue, refilled from a global budget of seeds.
+// When the budget is exhausted, idle workers steal half of the remaining range of another worker.
+class scheduler {
+public:
+	explicit scheduler(size_t workers = 0);
+
+	// budget == 0 means that there is no limit of seeds
+	void set_budget(Int budget);
+	// indices start at `first`, only when no worker is running
+	void set_first_index(Int first);
+	// only when no worker is running
+	void resize(size_t workers);
+
+	// fill the worker's queue with up to `size` indices, first from the ranges given back, then from the budget, then
+	// by stealing from other workers. Returns the size of the new range, 0 if there is no work left
+	Int refill(size_t worker, Int size);
+	// pop up to `count` indices from the worker's queue, the range is empty if the queue is empty
+	seed_range take(size_t worker, Int count);
+	// return the unprocessed part of the worker's queue, and the indices it took but did not process,
+	// so that another worker processes them later
+	void give_back(size_t worker, seed_range taken = seed_range());
+
+	// number of indices taken from the budget so far
+	Int distributed() const;
+	// cut the budget to the indices taken so far, even while workers take more, and return their number
+	Int close_budget();
+private:
+	seed_range take_from_budget(Int size);
+	seed_range take_given_back(Int size);
+	seed_range steal(size_t thief);
+
+	struct alignas(cache_line_size) queue {
+		std::mutex mutex;
+		seed_range r;
+	};
+
+	std::unique_ptr<queue[]> queues;
+	size_t workers;
+
+	Int first_index;
+	std::atomic<Int> next_index;
+	std::atomic<Int> budget; // end of the range of indices of the budget
+
+	std::mutex given_back_mutex;
+	std::vector<seed_range> given_back;
+	std::atomic<bool> has_given_back;
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+
+#include "generator/scheduler.h"
+#include "sampler/sampler.h"
+#include "types.h"
+
+// Seeds drawn ahead of the iteration kernel, for a range of consecutive indices. They are kept as arrays of real and
+// imaginary parts, so that the cheap tests proving an orbit bounded run vectorized over the whole block, and the
+// survivors are compacted so that the kernel is only handed the seeds it has to iterate, in index order
+class seed_block {
+public:
+	static constexpr size_t capacity { 2048 };
+
+	// draw the seeds of r, which holds at most capacity indices, and test them
+	void fill(sampler& seed_sampler, seed_range r);
+	// move to the next survivor, false when the block is exhausted. The bounded seeds skipped on the way are given
+	// a null feedback over `total` points when the sampler learns, and counted in `skipped`. The same sample handle is
+	// expected at each call, it is only updated for the samplers which do not learn
+	bool next(Int total, Int& index, sample_result& sample, Int& skipped);
+	// indices whose seeds were not handed out nor skipped yet
+	seed_range remaining() const;
+private:
+	Int first_index { 0 };
+	size_t size { 0 };
+	size_t cursor { 0 };       // next survivor
+	size_t position { 0 };     // next seed of the block, survivor or not
+
+	std::vector<Real> re, im, inside;
+	std::vector<uint32_t> survivors;
+	// a sample_result per seed for the samplers which learn, only the weights of the seeds for the others
+	bool learns { false };
+	std::vector<sample_result> samples;
+	std::vector<Int> weights;
+	bool plain_handle { false }; // the feedback of the last handle given out is a no-op
+};
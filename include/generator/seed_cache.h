@@ -0,0 +1,59 @@
+#pragma once
+
+#include <complex>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "generator/generator_info.h"
+#include "image/abstract_image.h"
+#include "types.h"
+
+// A seed which escaped in [minimum_iterations, iterations_to_escape) iterations during a render
+struct cached_seed {
+	std::complex<Real> z0;
+	uint32_t iterations;
+};
+
+// What the seeds of a cache were drawn from, and the sequence parameters they were accepted with
+struct seed_cache_header {
+	generator_properties properties;
+	generator_parameters parameters;
+
+	// whether the cache can be replayed with these parameters, reason is set otherwise. The cache holds exactly the
+	// seeds accepted with a lower or equal iterations_to_escape and a higher or equal minimum_iterations
+	bool replayable_with(const generator_parameters& other, std::string& reason) const;
+};
+
+// Append-only file of the seeds accepted during a render. Layout, in the host's byte order:
+//   "BBSEEDS" magic, format version, seed_cache_header field by field
+//   then the seeds, as real and imaginary parts and a 32-bits iteration count
+// Threads append whole buffers of seeds, so a file is only ever cut between two seeds
+class seed_cache_writer {
+public:
+	bool open(const std::string& path, const seed_cache_header& header);
+	bool append(const std::vector<cached_seed>& seeds);
+	Int written() const { return m_written; }
+private:
+	std::mutex mutex;
+	std::ofstream file;
+	Int m_written { 0 };
+};
+
+class seed_cache_reader {
+public:
+	bool open(const std::string& path);
+	const seed_cache_header& header() const { return m_header; }
+	// read up to `count` seeds, returns false at the end of the file
+	bool read(std::vector<cached_seed>& seeds, size_t count);
+private:
+	std::ifstream file;
+	seed_cache_header m_header;
+};
+
+// Scatter the orbits of the cached seeds accepted with these parameters into img, which shows properties' view.
+// Seeds are read by chunks and shared between `threads_number` threads
+generator_stats replay_seeds(seed_cache_reader& reader, const generator_properties& properties, const generator_parameters& parameters,
+                             abstractImage& img, uint32_t threads_number);
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads of the process, shared by every generator. A job runs on an idle thread, and a thread is only created when
+// none is idle, up to the capacity: beyond it, jobs are queued until a thread is done with its job. A generator's jobs
+// run as long as its render, so a generator with more threads than the capacity only runs part of them at once.
+// Pausing, resizing or replacing a generator reuses the threads, which are only joined when the process exits
+class thread_pool {
+public:
+	static thread_pool& shared();
+	~thread_pool();
+
+	void submit(std::function<void()> job);
+	// threads the pool may create, std::thread::hardware_concurrency() by default. Lowering it does not end the
+	// threads already created
+	void set_capacity(size_t capacity);
+	size_t capacity();
+	size_t size();
+	size_t idle();
+private:
+	thread_pool();
+	void start_threads(); // for the queued jobs which no idle thread will take, within the capacity
+	void run();
+
+	std::mutex mutex; // guards the fields below
+	std::condition_variable wake;
+	std::deque<std::function<void()>> jobs;
+	std::vector<std::thread> threads;
+	size_t idle_threads { 0 };
+	size_t max_threads;
+	bool exiting { false };
+};
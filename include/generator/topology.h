@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "generator/generator_info.h"
+
+// CPUs of each NUMA node of the machine
+struct numa_topology {
+	std::vector<std::vector<uint32_t>> nodes_cpus;
+
+	size_t node_of_cpu(uint32_t cpu) const;
+};
+
+// Read the topology from sysfs on Linux, otherwise (or on failure) a single node with all the hardware threads
+numa_topology detect_topology();
+
+// CPU assigned to each of the `threads_number` threads according to the policy, empty for thread_affinity::None
+std::vector<uint32_t> assign_cpus(const numa_topology& topology, thread_affinity affinity, const std::vector<uint32_t>& cores, uint32_t threads_number);
+
+// Restrict the calling thread to the given CPU, returns false if it is not supported or failed
+bool pin_current_thread(uint32_t cpu);
+// Let the calling thread run on any CPU of the topology again
+bool unpin_current_thread(const numa_topology& topology);
+
+// Parse a list such as "0-3,8,10-11"
+std::vector<uint32_t> parse_cpu_list(const std::string& list);
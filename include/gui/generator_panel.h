@@ -1,5 +1,7 @@
 #pragma once
 
+#include <chrono>
+
 #include "generator/generator.h"
 #include "generator/generator_info.h"
 #include "image/abstract_image.h"
@@ -21,13 +23,22 @@ public:
 private:
 	void display_panel();
 	void display_image(int display_width, int display_height);
+	void display_performance();
 
 	generator_properties properties;
 	generator_parameters parameters;
 	generator_runtime_parameters runtime_parameters;
+	char affinity_cores[256] {};
 	std::shared_ptr<abstractImage> image_ptr;
 	std::unique_ptr<generator> gen_ptr;
 
+	// throughput of the generator, refreshed every second
+	generator_stats last_stats;
+	generator_stats stats_per_second;
+	std::vector<generator_stats> last_node_stats;
+	std::vector<generator_stats> node_stats_per_second;
+	std::chrono::steady_clock::time_point last_stats_time;
+
 	// OpenGL info for rendering the image
 	GLuint vao;
 	GLuint vbo;
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+#include <cstring>
 #include <utility>
 
 template<class T>
@@ -7,4 +9,32 @@ std::pair<const T, const T> minmax(const T a, const T b)
 {
     return (b < a) ? std::pair<const T, const T>(b, a)
                    : std::pair<const T, const T>(a, b);
-}
\ No newline at end of file
+}
+
+// Mix the bits of x, to derive independent seeds from consecutive integers
+inline uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+    return x ^ (x >> 31);
+}
+
+// Uniform in [0, 1), from the 53 high bits of x
+inline double to_unit(uint64_t x)
+{
+    return static_cast<double>(x >> 11) * 0x1.0p-53;
+}
+
+// Fold a value into a hash, to identify the parameters a cached computation depends on
+inline uint64_t hash_combine(uint64_t key, uint64_t value)
+{
+    return splitmix64(key ^ value);
+}
+
+inline uint64_t hash_combine(uint64_t key, double value)
+{
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return splitmix64(key ^ bits);
+}
@@ -9,11 +9,15 @@ struct pixel {
 	uint8_t r, g, b;
 };
 
+// Grey level of a pixel hit `value` times, in an image whose most hit pixel was hit `max` times
+uint8_t tone_map(Int value, Int max);
+
 class abstractImage {
 public:
 	virtual Int read(uint16_t x, uint16_t y) = 0;
 	virtual void set(uint16_t x, uint16_t y, Int value) = 0;
 	virtual void incr(uint16_t x, uint16_t y) = 0;
+	virtual void add(uint16_t x, uint16_t y, Int value) = 0;
 	virtual std::vector<pixel> get_image() = 0;
 
 	uint16_t width() { return m_width; }
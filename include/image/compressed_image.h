@@ -12,6 +12,7 @@ public:
 	Int read(uint16_t, uint16_t);
 	void set(uint16_t, uint16_t, Int);
 	void incr(uint16_t, uint16_t);
+	void add(uint16_t, uint16_t, Int);
 private:
 	Int max;
 	std::vector<std::vector<Int>> data;
@@ -13,7 +13,11 @@ public:
 	Int read(uint16_t, uint16_t);
 	void set(uint16_t, uint16_t, Int);
 	void incr(uint16_t, uint16_t);
+	void add(uint16_t, uint16_t, Int);
 	std::vector<pixel> get_image();
+
+	// add every count of this image to target, and reset this image
+	void flush_into(abstractImage& target);
 private:
 	Int& at(uint16_t, uint16_t);
 
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "generator/generator_info.h"
+#include "image/abstract_image.h"
+#include "types.h"
+
+// A shard is the histogram of one part of a render, with everything needed to merge it with the other parts.
+// Layout of the file, every value being stored in the host's byte order:
+//   "BBSHARD" magic, format version
+//   generator_properties, generator_parameters and generator_stats, field by field
+//   number of RNG streams used, then the streams
+//   width * height counters, row by row
+struct shard_header {
+	generator_properties properties;
+	generator_parameters parameters;
+	generator_stats stats;
+	std::vector<Int> streams; // RNG streams the seeds were drawn from, shards to merge must not share any
+	                          // unless they are deterministic, their seeds being [first_seed_index, first_seed_index + stats.seeds)
+
+	// whether the two shards come from the same render, reason is set otherwise
+	bool compatible_with(const shard_header& other, std::string& reason) const;
+};
+
+class shard_writer {
+public:
+	bool open(const std::string& path, const shard_header& header);
+	// counters must hold rows * width values
+	bool write_rows(const Int* counters, size_t rows);
+	bool close();
+private:
+	std::ofstream file;
+	shard_header header;
+};
+
+class shard_reader {
+public:
+	bool open(const std::string& path);
+	const shard_header& header() const { return m_header; }
+	// counters must have room for rows * width values
+	bool read_rows(Int* counters, size_t rows);
+private:
+	std::ifstream file;
+	shard_header m_header;
+};
+
+// Header fields and streams alone, without the magic, for other files embedding a shard header
+void write_shard_header(std::ostream& stream, const shard_header& header);
+bool read_shard_header(std::istream& stream, shard_header& header);
+
+// Write the whole image as a single shard
+bool write_shard(const std::string& path, const shard_header& header, abstractImage& img);
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "image/abstract_image.h"
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+// Image living in POSIX shared memory, so that several processes can accumulate into the same histogram.
+// Counters are lock-free atomics, which are address-free and can therefore be shared between processes.
+class shared_image : public abstractImage {
+public:
+	~shared_image();
+
+	// create the shared memory object `name` (e.g. "/buddhabrot"), the creator unlinks it on destruction
+	bool create(const std::string& name, uint16_t width, uint16_t height);
+	// map an object created by another process
+	bool attach(const std::string& name);
+
+	Int read(uint16_t, uint16_t);
+	void set(uint16_t, uint16_t, Int);
+	void incr(uint16_t, uint16_t);
+	void add(uint16_t, uint16_t, Int);
+	std::vector<pixel> get_image();
+private:
+	struct header {
+		uint64_t magic;
+		uint16_t width;
+		uint16_t height;
+	};
+
+	bool map(int fd, size_t size);
+	std::atomic<Int>& at(uint16_t, uint16_t);
+
+	std::string name;
+	bool owner { false };
+	void* mapping { nullptr };
+	size_t mapping_size { 0 };
+	std::atomic<Int>* data { nullptr };
+};
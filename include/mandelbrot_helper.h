@@ -1,6 +1,9 @@
 #pragma once
 
+#include <cmath>
 #include <complex>
+#include <cstddef>
+#include <cstdint>
 
 template<typename real>
 bool insideCardioids(std::complex<real> z) {
@@ -10,4 +13,37 @@ bool insideCardioids(std::complex<real> z) {
 	// return true if inside second cardioid
 	return q * (q + z.real() - (real)0.25) < (real)0.25 * squared_img					// inside first cardioid
 		|| (z.real() + (real)1.) * (z.real() + (real)1.) + squared_img < (real)0.0625;	// inside second cardioid
-}
\ No newline at end of file
+}
+
+// Flag with 1 the seeds proved to have a bounded orbit by cheap analytic tests: the two cardioids of insideCardioids,
+// and disks inscribed in the period-3 bulbs and in the period-4 bulb of the real axis. The loop has no branch, so that
+// compilers vectorize it over the arrays
+template<typename real>
+void insideBulbs(const real* __restrict re, const real* __restrict im, real* __restrict inside, size_t n) {
+	for (size_t k = 0 ; k < n ; k++) {
+		real x = re[k];
+		real squared_img = im[k] * im[k];
+		real q = (x - (real)0.25) * (x - (real)0.25) + squared_img;
+		bool cardioid = q * (q + x - (real)0.25) < (real)0.25 * squared_img;
+		bool bulb_2 = (x + (real)1.) * (x + (real)1.) + squared_img < (real)0.0625;
+		// the period-3 bulbs are conjugate, both are tested at once on |imag|
+		real dx_3 = x + (real)0.122561166876654;
+		real dy_3 = std::abs(im[k]) - (real)0.744861766619744;
+		bool bulb_3 = dx_3 * dx_3 + dy_3 * dy_3 < (real)0.0064;
+		real dx_4 = x + (real)1.3107026413368328;
+		bool bulb_4 = dx_4 * dx_4 + squared_img < (real)0.0025;
+		inside[k] = cardioid | bulb_2 | bulb_3 | bulb_4 ? (real)1. : (real)0.;
+	}
+}
+
+// Number of iterations needed by the sequence z -> z² + z0 to leave the disk of squared radius escape_norm,
+// or max_iterations if it did not escape before
+template<typename real>
+uint64_t escape_iterations(std::complex<real> z0, uint64_t max_iterations, real escape_norm) {
+	std::complex<real> z = z0;
+	uint64_t i = 0;
+	for ( ; i < max_iterations && std::norm(z) < escape_norm ; i++) {
+		z = z * z + z0;
+	}
+	return i;
+}
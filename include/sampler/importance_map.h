@@ -0,0 +1,43 @@
+#pragma once
+
+#include <complex>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "generator/generator_info.h"
+#include "types.h"
+
+// Importance of the cells of a grid over the sampled seed domain, estimated by a pilot pass which traces a few seeds
+// of every cell: a cell's importance is the number of points its orbits put in the view, blurred over its neighbours,
+// plus a floor so that no cell is ever left out. Seeds drawn in proportion to the importance have their orbits weighted
+// by its inverse, so the image stays unbiased. Weights are scaled so that the most important cells weigh 1.
+// The pilot only depends on its parameters, so its map is cached on disk and shared by the shards of a render.
+class importance_map {
+public:
+	// the map of these parameters found in `directory`, or a new pilot pass run by the calling thread and jobs of
+	// the shared thread pool, `threads_number` at most, which is saved into `directory` unless it is empty
+	static std::shared_ptr<const importance_map> load_or_build(std::complex<Real> seed_a, std::complex<Real> seed_b,
+	                                                           const generator_properties& properties, const generator_parameters& parameters,
+	                                                           uint32_t threads_number, const std::string& directory);
+
+	uint32_t resolution() const { return m_resolution; }
+	// cell index, row by row, drawn in proportion to the importance for u uniform in [0, 1)
+	size_t cell_of(Real u) const;
+	// how many times the orbits of the cell's seeds count, at least 1
+	Real weight(size_t cell) const { return weights[cell]; }
+private:
+	importance_map(Int key, uint32_t resolution) : key(key), m_resolution(resolution) {}
+
+	void pilot(std::complex<Real> seed_a, std::complex<Real> seed_b, const generator_properties& properties,
+	           const generator_parameters& parameters, uint32_t threads_number, Int pilot_seeds);
+	void finish(); // derive the distribution and the weights from the importance
+	bool load(const std::string& path);
+	bool save(const std::string& path) const;
+
+	Int key; // hash of everything the pilot depends on
+	uint32_t m_resolution;
+	std::vector<Real> importance;
+	std::vector<Real> cdf;
+	std::vector<Real> weights;
+};
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "sampler/sampler.h"
+
+#include <memory>
+
+#include "sampler/importance_map.h"
+#include "types.h"
+
+// Draws seeds from the cells of an importance map in proportion to their importance, each seed carrying the weight
+// of its cell. Like index_sampler, the seed of index i only depends on the stream and on i
+class importance_sampler : public non_learning_sampler {
+public:
+	// corner_a and corner_b are the domain the map was built over
+	importance_sampler(std::complex<Real> corner_a, std::complex<Real> corner_b, std::shared_ptr<const importance_map> map, Int stream);
+	std::complex<Real> draw(Int index, Int& weight);
+private:
+	std::complex<Real> corner_a, corner_b;
+	std::shared_ptr<const importance_map> map;
+	Int key;
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "sampler/sampler.h"
+
+#include "types.h"
+
+// Counter-based sampler: the seed of index i only depends on the stream and on i, neither on the thread drawing it
+// nor on the previous draws, so that a render is reproducible whatever the number of threads
+class index_sampler : public non_learning_sampler {
+public:
+	index_sampler(std::complex<Real> corner_a, std::complex<Real> corner_b, Int stream);
+	std::complex<Real> draw(Int index, Int& weight);
+private:
+	std::complex<Real> corner_a, corner_b;
+	Int key;
+};
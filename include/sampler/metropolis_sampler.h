@@ -0,0 +1,42 @@
+#pragma once
+
+#include <complex>
+#include <random>
+
+#include "types.h"
+
+// Metropolis-Hastings chain over the seeds, whose stationary density is proportional to the contribution of a seed,
+// i.e. the number of points of its orbit which land in the view. Seeds whose orbits never cross a zoomed view are
+// then almost never drawn. Proposals are either small mutations around the current seed or large mutations, drawn
+// uniformly over the seed domain, and both are symmetric, so a proposal is accepted with probability
+// min(1, new contribution / current contribution).
+// The chain oversamples seeds by their contribution, so every step must splat the orbit of the current seed with a
+// total weight of `splat_weight`, i.e. splat_weight / contribution per point, for the image to stay unbiased.
+class metropolis_sampler {
+public:
+	// the view sets the scale of the small mutations
+	metropolis_sampler(std::complex<Real> view_corner_a, std::complex<Real> view_corner_b,
+	                   std::complex<Real> seed_corner_a, std::complex<Real> seed_corner_b, Int seed);
+
+	std::complex<Real> propose();
+	// whether the proposal replaces the current seed, given its contribution
+	bool accept(Int contribution);
+	// Every point of the current orbit receives the whole part of splat_weight / contribution, then extra_points()
+	// points, each picked uniformly by pick_point(), receive one more, which is exact in expectation. A step then costs
+	// O(min(contribution, splat_weight)) increments
+	Int whole_weight() const;
+	Int extra_points();
+	Int pick_point();
+
+	static constexpr Real large_mutation_probability { 0.1 };
+	static constexpr Int splat_weight { 64 };
+private:
+	std::ranlux48 engine;
+	std::uniform_real_distribution<Real> unit;
+
+	Real min_radius, max_radius;
+	std::complex<Real> seed_corner_a, seed_size;
+	std::complex<Real> current { 0. };
+	std::complex<Real> proposal { 0. };
+	Int current_contribution { 0 };
+};
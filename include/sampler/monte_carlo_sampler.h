@@ -1,6 +1,7 @@
 #pragma once
 #include "sampler/sampler.h"
 
+#include <memory>
 #include <random>
 #include <queue>
 
@@ -9,15 +10,18 @@
 
 class monte_carlo_sampler : public sampler {
 public:
-	monte_carlo_sampler(std::complex<Real> corner_a, std::complex<Real> corner_b, Int layers, Int layer_resolution);
-	sample_result sample();
+	monte_carlo_sampler(std::complex<Real> corner_a, std::complex<Real> corner_b, Int layers, Int layer_resolution, Int max_nodes);
+	monte_carlo_sampler(std::complex<Real> corner_a, std::complex<Real> corner_b, Int layers, Int layer_resolution, Int max_nodes, Int seed);
+	// the tree may be shared with the samplers of other threads
+	monte_carlo_sampler(std::complex<Real> corner_a, std::complex<Real> corner_b, std::shared_ptr<monte_carlo_tree> tree, Int seed);
+	sample_result sample(Int index);
+	// the tree picks the cell of best score, so seeds drawn ahead of feedback would all fall into the same cell
+	size_t lookahead() const { return 1; }
 
-	monte_carlo_tree tree;
+	std::shared_ptr<monte_carlo_tree> tree;
 private:
-	Int layers, layer_resolution;
 	std::complex<Real> corner_a, corner_b;
 
-	std::random_device rd;
 	std::ranlux48 engine;
 	std::uniform_real_distribution<Real> real_distrib;
 	std::uniform_real_distribution<Real> imag_distrib;
@@ -1,35 +1,74 @@
 #pragma once
 
-#include <map>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
 #include <queue>
+#include <string>
+#include <vector>
 
 #include "types.h"
 
+// Bandit tree over the seed domain: each node is a cell, split into layer_resolution² sub-cells, and samples descend
+// to the leaf of best UCB score. The tree grows lazily: a leaf is only split once enough samples showed that its cell
+// yields points in the view, up to `layers` levels and `max_nodes` nodes. Cells whose sub-cells yielded nothing after
+// many samples are merged back, and their nodes reused elsewhere.
+//
+// One tree is shared by the samplers of all threads, so that each of them benefits from the others' feedback. Counters
+// are relaxed atomics: a sample may read slightly stale statistics, which only matters to the choice of its cell.
+// Splits and merges are serialized by a mutex which threads never wait for: when it is busy, the change is postponed
+// to a later feedback. Nodes are allocated by chunks that are never freed, so a thread descending into a block which
+// is being merged and reused only disturbs statistics.
 class monte_carlo_tree {
 public:
-	monte_carlo_tree(uint16_t layers, uint16_t layer_resolution);
+	monte_carlo_tree(uint16_t layers, uint16_t layer_resolution, Int max_nodes);
 	using coordinate = std::pair<uint16_t, uint16_t>;
 	using path = std::queue<coordinate>;
 
-	path sample_path();
+	path sample_path() const;
 	void feedback(path& path, Int success, Int total);
 
+	// cells and counters of the tree, so that later renders of the same scene start from what this one learnt.
+	// Neither may be called while samples are drawn
+	bool save(const std::string& path) const;
+	// replaces the tree by a saved one, whose counters are scaled by decay so that new feedback soon outweighs them
+	bool load(const std::string& path, Real decay);
+
+	uint16_t resolution() const { return layer_resolution; }
+	size_t nodes() const { return 1 + used_blocks.load(std::memory_order_relaxed) * block_size; }
+
+	// samples a leaf receives before it can be split, and a node with children before it can be merged back
+	static constexpr uint32_t split_visits { 64 };
+	static constexpr uint32_t merge_visits { 1024 };
+private:
+	static constexpr uint32_t no_children { 0 }; // blocks are numbered from 1, so 0 marks a leaf
+
 	struct node {
-	public:
-		node(monte_carlo_tree* root, node* parent, uint16_t layers, uint16_t layer_resolution);
-
-		bool has_children() const;
-		void sample(monte_carlo_tree::path& p) const;
-		void feedback(monte_carlo_tree::path& p, Int success, Int total);
-		double score() const;
-
-		std::pair<Int, Int> rate;
-		std::map<monte_carlo_tree::coordinate, node> children;
-	private:
-		node* parent;			// non-owning ptr
-		monte_carlo_tree* root; // non-owning ptr
+		std::atomic<Int> success { 0 };
+		std::atomic<Int> total   { 0 };
+		std::atomic<uint32_t> visits { 0 };
+		std::atomic<uint32_t> first_child { no_children }; // block of layer_resolution² children
+
+		double score(Int parent_total) const;
+		void reset();
 	};
-private:
-	Int total;
-	node root;
-};
\ No newline at end of file
+
+	node& child(uint32_t block, size_t i) const;
+	uint32_t allocate_block(); // with structure_mutex owned, no_children when the cap is reached
+	void clear();
+	void split(node& n);
+	void merge(node& n);
+
+	uint16_t layers, layer_resolution;
+	size_t block_size;
+	size_t blocks_per_chunk;
+	uint32_t max_blocks;
+	mutable node root;
+
+	std::mutex structure_mutex; // guards the fields below
+	std::vector<std::unique_ptr<node[]>> chunks; // allocated up front, filled as blocks are needed
+	uint32_t allocated_blocks { 0 };
+	std::vector<uint32_t> free_blocks;
+	std::atomic<size_t> used_blocks { 0 };
+};
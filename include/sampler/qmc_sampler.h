@@ -0,0 +1,34 @@
+#pragma once
+
+#include "sampler/sampler.h"
+
+#include <cstdint>
+#include <utility>
+
+#include "types.h"
+
+enum class qmc_sequence {
+	Sobol,	// Sobol' points, with hash-based Owen scrambling
+	Halton,	// bases 2 and 3, with random digit permutations
+	R2		// Roberts' additive recurrence, with a random toroidal shift
+};
+
+// Quasi-Monte Carlo sampler: the seed of index i is the i-th point of a randomized low-discrepancy sequence.
+// The global index stands for per-thread leapfrogging, the threads drawing the disjoint index ranges of the scheduler
+// from the same sequence. The randomization derives from `seed`, so renders with distinct streams are independent.
+class qmc_sampler : public non_learning_sampler {
+public:
+	qmc_sampler(std::complex<Real> corner_a, std::complex<Real> corner_b, qmc_sequence sequence, Int seed);
+	std::complex<Real> draw(Int index, Int& weight);
+private:
+	std::pair<Real, Real> sobol(Int index) const;
+	std::pair<Real, Real> halton(Int index) const;
+	std::pair<Real, Real> r2(Int index) const;
+
+	static constexpr int base3_digits { 41 }; // 3^41 > 2^64
+
+	std::complex<Real> corner_a, corner_b;
+	qmc_sequence sequence;
+	Int key;
+	uint8_t base3_permutations[base3_digits][3];
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <complex>
+#include <cstddef>
 #include <functional>
 #include <memory>
 
@@ -11,6 +12,7 @@ struct sample_result {
 	std::complex<Real> sample;
 	std::shared_ptr<void> data_ptr;
 	feedback_fn feedback;
+	Int weight { 1 }; // times each point of the orbit counts, for the samplers which do not draw seeds uniformly
 
 	void feedback_result(Int success, Int total) {
 		feedback(data_ptr, success, total);
@@ -19,5 +21,27 @@ struct sample_result {
 
 class sampler {
 public:
-	virtual sample_result sample() = 0;
+	// index is the global index of the seed in the render, only used by the samplers which derive seeds from it
+	virtual sample_result sample(Int index) = 0;
+	// seeds which may be drawn ahead of the feedback of the first one, small for the samplers learning from feedback
+	virtual size_t lookahead() const { return SIZE_MAX; }
+	// false when the feedback is ignored, the seeds are then drawn by draw, without a sample_result each
+	virtual bool learns() const { return true; }
+	virtual std::complex<Real> draw(Int index, Int& weight) {
+		sample_result res { sample(index) };
+		weight = res.weight;
+		return res.sample;
+	}
+};
+
+// Samplers which learn nothing from feedback: a seed is only its coordinates and its weight
+class non_learning_sampler : public sampler {
+public:
+	sample_result sample(Int index) {
+		Int weight;
+		std::complex<Real> seed { draw(index, weight) };
+		return sample_result{ seed, nullptr, [](std::shared_ptr<void>, Int, Int){ return; }, weight };
+	}
+	bool learns() const { return false; }
+	std::complex<Real> draw(Int index, Int& weight) = 0;
 };
\ No newline at end of file
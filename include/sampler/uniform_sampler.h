@@ -4,12 +4,12 @@
 
 #include <random>
 
-class uniform_sampler : public sampler {
+class uniform_sampler : public non_learning_sampler {
 public:
 	uniform_sampler(std::complex<Real> corner_a, std::complex<Real> corner_b);
-	sample_result sample();
+	uniform_sampler(std::complex<Real> corner_a, std::complex<Real> corner_b, Int seed);
+	std::complex<Real> draw(Int index, Int& weight);
 private:
-	std::random_device rd;
 	std::ranlux48 engine;
 	std::uniform_real_distribution<Real> real_distrib;
 	std::uniform_real_distribution<Real> imag_distrib;
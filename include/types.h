@@ -1,6 +1,10 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
 using Real = double;
-using Int = uint64_t;
\ No newline at end of file
+using Int = uint64_t;
+
+// used to keep data written by different threads on distinct cache lines
+constexpr std::size_t cache_line_size = 64;
\ No newline at end of file
@@ -0,0 +1,179 @@
+#include "coordinator/coordinator.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <type_traits>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static_assert(std::is_trivially_copyable_v<worker_report> && std::is_trivially_copyable_v<budget_grant>,
+	"messages are sent as raw bytes between processes of the same executable");
+
+namespace {
+	bool send_all(int fd, const void* buffer, size_t size) {
+		const char* p { static_cast<const char*>(buffer) };
+		while (size > 0) {
+			ssize_t n { ::send(fd, p, size, MSG_NOSIGNAL) };
+			if (n <= 0)
+				return false;
+			p += n;
+			size -= n;
+		}
+		return true;
+	}
+
+	bool receive_all(int fd, void* buffer, size_t size) {
+		char* p { static_cast<char*>(buffer) };
+		while (size > 0) {
+			ssize_t n { ::recv(fd, p, size, 0) };
+			if (n <= 0)
+				return false;
+			p += n;
+			size -= n;
+		}
+		return true;
+	}
+
+	bool make_address(const std::string& path, sockaddr_un& address) {
+		std::memset(&address, 0, sizeof(address));
+		address.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(address.sun_path))
+			return false;
+		std::strcpy(address.sun_path, path.c_str());
+		return true;
+	}
+}
+
+coordinator::~coordinator() {
+	for (auto& c : clients)
+		close(c.fd);
+	if (listen_fd >= 0) {
+		close(listen_fd);
+		unlink(socket_path.c_str());
+	}
+}
+
+bool coordinator::listen(const std::string& socket_path_in) {
+	socket_path = socket_path_in;
+	sockaddr_un address;
+	if (!make_address(socket_path, address))
+		return false;
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listen_fd < 0)
+		return false;
+	unlink(socket_path.c_str());
+	return bind(listen_fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0
+	    && ::listen(listen_fd, 128) == 0;
+}
+
+void coordinator::set_target(Int points_target_in, Int chunk_in) {
+	points_target = points_target_in;
+	chunk = std::max<Int>(1, chunk_in);
+}
+
+void coordinator::stop(bool at_once) {
+	stopping = true;
+	stopping_at_once = stopping_at_once || at_once;
+}
+
+void coordinator::serve(size_t expected_workers, const std::function<bool()>& on_tick, double tick_seconds) {
+	auto last_tick { std::chrono::steady_clock::now() };
+	while (connected < expected_workers || !clients.empty()) {
+		std::vector<pollfd> fds;
+		fds.push_back({ listen_fd, POLLIN, 0 });
+		for (auto& c : clients)
+			fds.push_back({ c.fd, POLLIN, 0 });
+
+		if (poll(fds.data(), fds.size(), 100) > 0) {
+			// the clients are handled before accepting new ones, so that fds and clients stay aligned
+			for (size_t i { clients.size() } ; i-- > 0 ; ) {
+				if (fds[i + 1].revents == 0)
+					continue;
+				if (!handle(clients[i])) {
+					disconnect(clients[i]);
+					clients.erase(clients.begin() + i);
+				}
+			}
+			if (fds[0].revents & POLLIN) {
+				int fd { accept(listen_fd, nullptr, nullptr) };
+				if (fd >= 0) {
+					clients.push_back(client{ fd });
+					connected++;
+				}
+			}
+		}
+
+		auto now { std::chrono::steady_clock::now() };
+		std::chrono::duration<double> since_tick { now - last_tick };
+		if (since_tick.count() >= tick_seconds) {
+			last_tick = now;
+			if (!on_tick())
+				return;
+		}
+	}
+}
+
+bool coordinator::handle(client& c) {
+	worker_report report;
+	if (!receive_all(c.fd, &report, sizeof(report)))
+		return false;
+	c.last_report = report;
+
+	budget_grant grant;
+	if (report.wants_budget && !report.final && !stopping) {
+		Int remaining { points_target ? points_target - granted : chunk };
+		grant.seeds = std::min(chunk, remaining);
+	}
+	grant.stop = stopping_at_once;
+	granted += grant.seeds;
+	c.granted += grant.seeds;
+	return send_all(c.fd, &grant, sizeof(grant));
+}
+
+void coordinator::disconnect(client& c) {
+	close(c.fd);
+	retired_stats += c.last_report.stats;
+	retired_seeds_done += c.last_report.seeds_done;
+	// seeds granted to a worker which died before processing them are granted again to the others
+	if (!c.last_report.final && c.granted > c.last_report.seeds_done)
+		granted -= c.granted - c.last_report.seeds_done;
+}
+
+generator_stats coordinator::stats() const {
+	generator_stats res { retired_stats };
+	for (auto& c : clients)
+		res += c.last_report.stats;
+	return res;
+}
+
+Int coordinator::seeds_done() const {
+	Int res { retired_seeds_done };
+	for (auto& c : clients)
+		res += c.last_report.seeds_done;
+	return res;
+}
+
+coordinator_client::~coordinator_client() {
+	if (fd >= 0)
+		close(fd);
+}
+
+bool coordinator_client::connect(const std::string& socket_path) {
+	sockaddr_un address;
+	if (!make_address(socket_path, address))
+		return false;
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	return fd >= 0 && ::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+}
+
+budget_grant coordinator_client::request(const worker_report& report) {
+	budget_grant grant;
+	if (!send_all(fd, &report, sizeof(report)) || !receive_all(fd, &grant, sizeof(grant)))
+		return budget_grant{};
+	return grant;
+}
@@ -1,12 +1,42 @@
 #include "generator/generator.h"
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <random>
 
+#include "generator/seed_block.h"
+#include "generator/seed_cache.h"
+#include "generator/thread_pool.h"
 #include "helper.h"
 #include "image/image.h"
 #include "mandelbrot_helper.h"
+#include "sampler/importance_map.h"
+#include "sampler/importance_sampler.h"
+#include "sampler/index_sampler.h"
+#include "sampler/metropolis_sampler.h"
 #include "sampler/monte_carlo_sampler.h"
+#include "sampler/qmc_sampler.h"
+#include "sampler/uniform_sampler.h"
+
+struct generator::worker_context {
+	Int sampler_seed;
+	bool prepared { false }; // the sampler and the buffers are allocated by the first job, on the worker's CPU
+
+	// a Metropolis-Hastings chain replaces the sampler, since it needs the contribution of a seed before splatting it
+	std::unique_ptr<metropolis_sampler> chain;
+	pixel_list current_pixels, proposal_pixels;
+	std::unique_ptr<sampler> seed_sampler;
+
+	Int batch_size { 1 };
+	Int batch_done { 0 };
+	seed_range seeds; // indices taken from the thread's queue but not processed yet
+	seed_block block;
+	pixel_list pixels;
+	std::vector<cached_seed> recorded;
+	std::vector<pixel_queue::block*> band_blocks;
+};
 
 generator::generator(std::shared_ptr<abstractImage> image_ptr_in, generator_properties& properties_in, generator_parameters& parameters_in, generator_runtime_parameters& runtime_parameters_in) {
 	image_ptr = image_ptr_in;
@@ -14,8 +44,25 @@ generator::generator(std::shared_ptr<abstractImage> image_ptr_in, generator_prop
 	parameters = parameters_in;
 	runtime_parameters = runtime_parameters_in;
 
-	pool_points_done = 0;
 	total_points_done = 0;
+	spawned_threads = 0;
+	while (properties.rng_stream == 0)
+		properties.rng_stream = (static_cast<Int>(std::random_device()()) << 32) | std::random_device()();
+	// quasi-Monte Carlo and importance seeds only depend on their index, so such renders can be split by ranges of seeds
+	if (samples_by_index(properties.sampler_t))
+		properties.deterministic = true;
+	// the pilot pass runs before any thread starts
+	if (properties.sampler_t == sampler_type::ImportanceMap) {
+		auto [seed_a, seed_b] = sampled_seed_domain(properties, parameters);
+		pilot_map = importance_map::load_or_build(seed_a, seed_b, properties, parameters, runtime_parameters.threads_number, runtime_parameters.cache_directory);
+	}
+
+	if (properties.sampler_t == sampler_type::MonteCarlo && properties.shared_tree && !properties.deterministic)
+		shared_tree = make_shared_tree();
+
+	topology = detect_topology();
+	retired_node_stats.resize(topology.nodes_cpus.size());
+	work_scheduler.set_first_index(properties.first_seed_index);
 
 	m_status = status::Stopped;
 	initiate();
@@ -25,26 +72,201 @@ generator::~generator() {
 	stop();
 }
 
-void generator::join_all_threads_and_clear() {
-	for (auto& thread : threads) {
-		thread.join();
+// Lock the mutex, and account the time spent if it was already owned by another thread
+template<typename mutex_t>
+std::unique_lock<mutex_t> timed_lock(mutex_t& mutex, std::atomic<Int>& wait_ns) {
+	std::unique_lock<mutex_t> lock(mutex, std::try_to_lock);
+	if (!lock.owns_lock()) {
+		auto start { std::chrono::steady_clock::now() };
+		lock.lock();
+		std::chrono::nanoseconds waited { std::chrono::steady_clock::now() - start };
+		wait_ns.store(wait_ns.load(std::memory_order_relaxed) + waited.count(), std::memory_order_relaxed);
+	}
+	return lock;
+}
+
+void generator::thread_counters::reset() {
+	for (auto* counter : { &seeds, &cardioid_rejects, &non_escaping_rejects, &below_minimum_rejects, &accepted_orbits,
+	                       &missed_view_orbits, &orbit_points, &points_in_view, &lock_wait_ns })
+		counter->store(0, std::memory_order_relaxed);
+}
+
+static Int steady_ns() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+generator_stats generator::thread_counters::load() const {
+	generator_stats stats;
+	stats.seeds                 = seeds.load(std::memory_order_relaxed);
+	stats.cardioid_rejects      = cardioid_rejects.load(std::memory_order_relaxed);
+	stats.non_escaping_rejects  = non_escaping_rejects.load(std::memory_order_relaxed);
+	stats.below_minimum_rejects = below_minimum_rejects.load(std::memory_order_relaxed);
+	stats.accepted_orbits       = accepted_orbits.load(std::memory_order_relaxed);
+	stats.missed_view_orbits    = missed_view_orbits.load(std::memory_order_relaxed);
+	stats.orbit_points          = orbit_points.load(std::memory_order_relaxed);
+	stats.points_in_view        = points_in_view.load(std::memory_order_relaxed);
+	stats.lock_wait_ns          = lock_wait_ns.load(std::memory_order_relaxed);
+	return stats;
+}
+
+void generator::retire_workers() {
+	{
+		std::unique_lock<std::mutex> lock(workers_mutex);
+		workers_done.wait(lock, [this]{ return active_workers == 0 && active_scatters == 0; });
+	}
+	bands.clear();
+	band_of_row.clear();
+	for (size_t i { 0 } ; i < threads_state.size() ; i++)
+		retire_worker(i);
+	threads_state.clear();
+
+	merge_replicas();
+	replicas.clear();
+}
+
+// The worker gives back the seeds it took, and its counters are accounted as retired. Only while it has no job
+void generator::retire_worker(size_t thread_index) {
+	thread_state& state { *threads_state[thread_index] };
+	worker_context& context { *state.context };
+	save_progress(thread_index, context.batch_done);
+	// the block's range ends where the taken indices resume
+	if (!context.block.remaining().empty())
+		context.seeds.begin = context.block.remaining().begin;
+	work_scheduler.give_back(thread_index, context.seeds);
+	context.seeds = seed_range();
+	context.block = seed_block();
+	retire_counters(state);
+}
+
+void generator::retire_counters(thread_state& state) {
+	generator_stats stats { state.counters.load() };
+	retired_stats += stats;
+	if (state.pinned)
+		retired_node_stats[state.node] += stats;
+	state.counters.reset();
+}
+
+// Each replica is allocated, hence zeroed, by a thread running on its node, so that its pages live in the node's memory
+void generator::allocate_replicas() {
+	std::vector<bool> used(topology.nodes_cpus.size(), false);
+	for (auto& state : threads_state)
+		if (state->pinned)
+			used[state->node] = true;
+	if (std::count(used.begin(), used.end(), true) < 2)
+		return;
+
+	replicas.resize(topology.nodes_cpus.size());
+	std::vector<std::thread> allocators;
+	for (size_t node { 0 } ; node < used.size() ; node++) {
+		if (!used[node])
+			continue;
+		replicas[node] = std::make_unique<image_replica>();
+		allocators.emplace_back([this, node]{
+			pin_current_thread(topology.nodes_cpus[node].front());
+			replicas[node]->img = std::make_unique<image>(properties.image_width, properties.image_height);
+		});
+	}
+	for (auto& allocator : allocators)
+		allocator.join();
+}
+
+// The histogram is split into bands of rows of the same height, each one owned by a scatter thread which has a queue
+// from every iteration thread
+void generator::allocate_bands(size_t count) {
+	constexpr size_t queue_blocks { 16 };
+	uint16_t height { properties.image_height };
+	count = std::clamp<size_t>(count, 1, height);
+	band_of_row.resize(height);
+	for (size_t b { 0 } ; b < count ; b++) {
+		bands.push_back(std::make_unique<scatter_band>());
+		scatter_band& band { *bands.back() };
+		band.first_row = static_cast<uint16_t>(height * b / count);
+		band.end_row = static_cast<uint16_t>(height * (b + 1) / count);
+		std::fill(band_of_row.begin() + band.first_row, band_of_row.begin() + band.end_row, static_cast<uint16_t>(b));
+		for (size_t i { 0 } ; i < runtime_parameters.threads_number ; i++)
+			band.queues.push_back(std::make_unique<pixel_queue>(queue_blocks));
+	}
+}
+
+void generator::merge_replicas() {
+	for (auto& replica : replicas) {
+		if (!replica)
+			continue;
+		std::lock_guard<std::mutex> replica_lock(replica->mutex);
+		std::lock_guard<std::mutex> image_lock(image_ptr_mutex);
+		replica->img->flush_into(*image_ptr);
 	}
-	threads.clear();
-	threads_points_done.clear();
-	threads_batch_size.clear();
 }
 
 void generator::set_parameters(generator_parameters& parameters_in) {
 	if (m_status != status::Stopped)
 		return;
+	// the tree's cells depend on the sampled seed domain, and its counters on the iterations
+	bool tree_outdated { parameters.y_symetry != parameters_in.y_symetry || parameters.escape_norm != parameters_in.escape_norm
+	                  || parameters.iterations_to_escape != parameters_in.iterations_to_escape
+	                  || parameters.minimum_iterations != parameters_in.minimum_iterations };
 	parameters = parameters_in;
+	if (tree_outdated && shared_tree)
+		shared_tree = make_shared_tree();
+	if (pilot_map) {
+		auto [seed_a, seed_b] = sampled_seed_domain(properties, parameters);
+		pilot_map = importance_map::load_or_build(seed_a, seed_b, properties, parameters, runtime_parameters.threads_number, runtime_parameters.cache_directory);
+	}
 }
 
 void generator::set_runtime_parameters(generator_runtime_parameters& runtime_parameters_in) {
-	if (m_status != status::Stopped)
+	if (m_status == status::Stopped) {
+		runtime_parameters = runtime_parameters_in;
+		initiate();
 		return;
+	}
+
+	// the jobs leave at their next seed, the workers are reconfigured, then the jobs of a running generator resume.
+	// A batch being finished on request ends there
+	order previous;
+	{
+		std::unique_lock<std::mutex> lock(workers_mutex);
+		previous = m_order;
+		m_order = order::Pause;
+		workers_done.wait(lock, [this]{ return active_workers == 0 && active_scatters == 0; });
+	}
+	bool batch_size_changed { runtime_parameters.thread_batch_size != runtime_parameters_in.thread_batch_size };
 	runtime_parameters = runtime_parameters_in;
-	initiate();
+	// a reached target cut the budget to the seeds handed out, which a new points target must not extend
+	if (m_reached_target == render_target::None)
+		work_scheduler.set_budget(runtime_parameters.points_target);
+	configure_workers();
+	// the other workers adapt the size of their next batch to batch_duration_ms
+	if (batch_size_changed)
+		for (auto& state : threads_state)
+			state->context->batch_size = std::max<Int>(1, runtime_parameters.thread_batch_size);
+
+	std::lock_guard<std::mutex> lock(workers_mutex);
+	m_order = previous == order::Run ? order::Run : order::Pause;
+	if (m_order == order::Run)
+		start_jobs();
+}
+
+void generator::set_points_target(Int points_target) {
+	runtime_parameters.points_target = points_target;
+	if (m_reached_target == render_target::None)
+		work_scheduler.set_budget(points_target);
+}
+
+void generator::finish_handed_out_seeds() {
+	// closed at once, so that no worker takes seeds between the count and the cut. A points target of 0 meaning no
+	// limit, a render which had no seed yet ends after its first one
+	set_points_target(std::max<Int>(1, work_scheduler.close_budget()));
+}
+
+void generator::set_seed_recorder(std::shared_ptr<seed_cache_writer> recorder) {
+	// threads may be appending to the current recorder as long as they exist, a first one can be set while paused
+	// weighted seeds could not be replayed with their weight
+	if (properties.sampler_t == sampler_type::MetropolisHastings || properties.sampler_t == sampler_type::ImportanceMap || m_status == status::Running
+	|| (m_status != status::Stopped && seed_recorder_owner))
+		return;
+	seed_recorder_owner = recorder;
+	seed_recorder = recorder.get();
 }
 
 void generator::initiate() {
@@ -53,25 +275,106 @@ void generator::initiate() {
 
 	m_order = order::Pause;
 	m_status = status::Paused;
-	for (size_t i {0} ; i < runtime_parameters.threads_number ; i++) {
-		threads_points_done.emplace_back(0);
-		threads_batch_size.emplace_back(0);
-		threads.emplace_back(std::thread([i, this]{ this->task(i); }));
+	work_scheduler.set_budget(runtime_parameters.points_target);
+	m_reached_target = render_target::None;
+	points_target_at_target = 0;
+	run_ns_before_resume = 0;
+	noise_snapshot.clear();
+	noise_snapshot_seeds = 0;
+	m_noise_estimate = 0.;
+	// the workers only get a thread of the pool when the generator is resumed
+	configure_workers();
+}
+
+// Add or retire workers to match threads_number, pin them, and lay the image out for them. Only while no job runs.
+// The workers which are kept keep their sampler, buffers and the seeds they took
+void generator::configure_workers() {
+	size_t count { runtime_parameters.threads_number };
+	for ( ; threads_state.size() > count ; threads_state.pop_back())
+		retire_worker(threads_state.size() - 1);
+	// the queues of the scheduler are given back, so that the new workers share their seeds
+	work_scheduler.resize(count);
+
+	std::vector<uint32_t> cpus { assign_cpus(topology, runtime_parameters.affinity, runtime_parameters.affinity_cores, runtime_parameters.threads_number) };
+	for (size_t i { 0 } ; i < count ; i++) {
+		if (i == threads_state.size()) {
+			threads_state.emplace_back(std::make_unique<thread_state>());
+			threads_state.back()->context = std::make_unique<worker_context>();
+			threads_state.back()->context->sampler_seed = splitmix64(splitmix64(properties.rng_stream) + spawned_threads++);
+		}
+		thread_state& state { *threads_state[i] };
+		bool pinned { !cpus.empty() };
+		size_t node { pinned ? topology.node_of_cpu(cpus[i]) : 0 };
+		// the counters of each node only account for the work done on it
+		if (state.pinned != pinned || state.node != node)
+			retire_counters(state);
+		state.pinned = pinned;
+		state.cpu = pinned ? cpus[i] : 0;
+		state.node = node;
 	}
+
+	merge_replicas();
+	replicas.clear();
+	bands.clear();
+	band_of_row.clear();
+	// scatter threads own the bands of the histogram, so the iteration threads do not need replicas. The scatter jobs
+	// wait for the iteration jobs, so the pool must leave a thread to at least one of them
+	size_t scatter_count { std::min<size_t>(runtime_parameters.scatter_threads, thread_pool::shared().capacity() - 1) };
+	if (scatter_count != 0 && properties.sampler_t != sampler_type::MetropolisHastings)
+		allocate_bands(scatter_count);
+	else
+		allocate_replicas();
+	for (auto& state : threads_state)
+		state->context->band_blocks.assign(bands.size(), nullptr);
 }
 
 void generator::resume() {
 	if (m_status != status::Paused)
 		return;
 
+	std::lock_guard<std::mutex> lock(workers_mutex);
+	resumed_at_ns = steady_ns();
 	m_order = order::Run;
 	m_status = status::Running;
+	start_jobs();
+}
+
+// Jobs still running keep running, since the order is changed under the same lock as they check it before leaving.
+// The scatter jobs are submitted first, so that they are not queued behind the iteration jobs which wait for them
+void generator::start_jobs() {
+	thread_pool& pool { thread_pool::shared() };
+	for (size_t b { 0 } ; b < bands.size() ; b++) {
+		if (bands[b]->running)
+			continue;
+		bands[b]->running = true;
+		active_scatters++;
+		pool.submit([b, this]{ this->scatter_task(b); });
+	}
+	for (size_t i { 0 } ; i < threads_state.size() ; i++) {
+		if (threads_state[i]->running)
+			continue;
+		threads_state[i]->running = true;
+		active_workers++;
+		pool.submit([i, this]{ this->task(i); });
+	}
+}
+
+bool generator::leave_job(thread_state& state) {
+	std::lock_guard<std::mutex> lock(workers_mutex);
+	if (m_order == order::Run && m_reached_target == render_target::None)
+		return false;
+	state.running = false;
+	active_workers--;
+	// notified with the lock owned, so that the generator cannot be destroyed before
+	workers_done.notify_all();
+	return true;
 }
 
 void generator::pause() {
 	if (m_status != status::Running)
 		return;
 
+	run_ns_before_resume += steady_ns() - resumed_at_ns;
 	m_order = order::Pause;
 	m_status = status::Paused;
 }
@@ -84,10 +387,50 @@ void generator::finish_bash() {
 }
 
 void generator::stop() {
+	bool was_stopped { m_status == status::Stopped };
+	if (m_status == status::Running)
+		run_ns_before_resume += steady_ns() - resumed_at_ns;
 	m_order = order::Stop;
 	m_status = status::Stopping;
-	join_all_threads_and_clear();
+	retire_workers();
 	m_status = status::Stopped;
+	if (!was_stopped)
+		save_shared_tree();
+}
+
+std::string generator::tree_cache_path() const {
+	if (runtime_parameters.cache_directory.empty())
+		return {};
+	auto [seed_a, seed_b] = sampled_seed_domain(properties, parameters);
+	Int key { splitmix64(properties.layers) };
+	for (Real value : { seed_a.real(), seed_a.imag(), seed_b.real(), seed_b.imag(),
+	                    properties.corner_a.real(), properties.corner_a.imag(), properties.corner_b.real(), properties.corner_b.imag(), parameters.escape_norm })
+		key = hash_combine(key, value);
+	for (Int value : { properties.layer_resolution, parameters.iterations_to_escape, parameters.minimum_iterations, static_cast<Int>(parameters.y_symetry) })
+		key = hash_combine(key, value);
+	char name[64];
+	std::snprintf(name, sizeof(name), "/tree-%016llx.mct", static_cast<unsigned long long>(key));
+	return runtime_parameters.cache_directory + name;
+}
+
+std::shared_ptr<monte_carlo_tree> generator::make_shared_tree() const {
+	auto tree { std::make_shared<monte_carlo_tree>(properties.layers, properties.layer_resolution, properties.tree_max_nodes) };
+	std::string path { tree_cache_path() };
+	if (!path.empty() && properties.tree_decay > 0.)
+		tree->load(path, std::min<Real>(1., properties.tree_decay));
+	return tree;
+}
+
+// Renders sharing the cache directory may stop together, each one writes its own file then renames it
+void generator::save_shared_tree() const {
+	std::string path { tree_cache_path() };
+	if (!shared_tree || path.empty())
+		return;
+	std::string temporary { path + "." + std::to_string(std::random_device()()) };
+	if (shared_tree->save(temporary))
+		std::rename(temporary.c_str(), path.c_str());
+	else
+		std::remove(temporary.c_str());
 }
 
 status generator::get_status() {
@@ -96,65 +439,268 @@ status generator::get_status() {
 
 std::vector<std::pair<Int, Int>> generator::progress() {
 	std::vector<std::pair<Int, Int>> res;
-	std::lock_guard<std::mutex> lock(access_progress_mutex);
-	for (size_t i { 0 } ; i < runtime_parameters.threads_number ; i++) {
-		res.emplace_back(threads_points_done[i], threads_batch_size[i]);
+	for (auto& state : threads_state) {
+		res.emplace_back(state->points_done.load(std::memory_order_relaxed), state->batch_size.load(std::memory_order_relaxed));
 	}
 	return res;
 }
 
 std::pair<Int, Int> generator::pool_progress() {
-	Int ongoing { std::accumulate(threads_points_done.begin(), threads_points_done.end(), (Int)0) };
-	return std::make_pair(pool_points_done + ongoing, runtime_parameters.pool_batch_size);
+	Int pool_points_done { total_progress().first };
+	if (runtime_parameters.pool_batch_size != 0) // pool_batch_size == 0 means that there is a single pool
+		pool_points_done %= runtime_parameters.pool_batch_size;
+	return std::make_pair(pool_points_done, runtime_parameters.pool_batch_size);
 }
 
 std::pair<Int, Int> generator::total_progress() {
-	Int ongoing { std::accumulate(threads_points_done.begin(), threads_points_done.end(), (Int)0) };
-	return std::make_pair(total_points_done + ongoing, runtime_parameters.points_target);
+	Int ongoing { 0 };
+	for (auto& state : threads_state)
+		ongoing += state->points_done.load(std::memory_order_relaxed);
+	Int cut { points_target_at_target.load() };
+	return std::make_pair(total_points_done + ongoing, cut != 0 ? cut : runtime_parameters.points_target);
 }
 
-Int generator::request_batch(size_t thread_index) {
-	std::lock_guard<std::mutex> lock(access_progress_mutex);
-	Int ongoing { std::accumulate(threads_batch_size.begin(), threads_batch_size.end(), (Int)0) };
-	Int batch_target { runtime_parameters.thread_batch_size };
+generator_stats generator::stats() {
+	generator_stats res { retired_stats };
+	for (auto& state : threads_state)
+		res += state->counters.load();
+	return res;
+}
 
-	if (runtime_parameters.pool_batch_size != 0) { // points_target == 0 means that there is no limit of points for the pool
-		Int remaining_in_pool { runtime_parameters.pool_batch_size - pool_points_done - ongoing }; // should be always greater or equal than 0
-		if (batch_target > remaining_in_pool)
-			batch_target = remaining_in_pool;
+std::vector<generator_stats> generator::node_stats() {
+	std::vector<generator_stats> res { retired_node_stats };
+	bool any_pinned { false };
+	for (auto& state : threads_state) {
+		if (!state->pinned)
+			continue;
+		res[state->node] += state->counters.load();
+		any_pinned = true;
 	}
+	if (!any_pinned)
+		res.clear();
+	return res;
+}
+
+Int generator::running_ns() const {
+	return run_ns_before_resume + (steady_ns() - resumed_at_ns);
+}
+
+Int generator::running_ms() const {
+	return (m_status == status::Running ? running_ns() : run_ns_before_resume.load()) / 1000000;
+}
 
-	if (runtime_parameters.points_target != 0) { // points_target == 0 means that there is no limit of points in total
-		Int remaining_in_total { runtime_parameters.points_target - total_points_done - ongoing }; // should be always greater or equal than 0
-		if (batch_target > remaining_in_total)
-			batch_target = remaining_in_total;
+// Only the first worker to see a target ends the render: the budget of seeds is cut to what was handed out, so the
+// workers finish the seeds they took, then leave their jobs. That cut becomes the points target of total_progress, so
+// that the caller waits for those seeds and a deterministic render has no gap
+void generator::check_targets() {
+	if (m_reached_target != render_target::None)
+		return;
+	render_target reached { render_target::None };
+	if (runtime_parameters.time_budget_ms != 0 && running_ns() >= runtime_parameters.time_budget_ms * 1000000)
+		reached = render_target::TimeBudget;
+	else if (runtime_parameters.accepted_orbits_target != 0 && stats().accepted_orbits >= runtime_parameters.accepted_orbits_target)
+		reached = render_target::AcceptedOrbits;
+	else if (runtime_parameters.noise_target > 0. && noise_below_target())
+		reached = render_target::Noise;
+	if (reached == render_target::None)
+		return;
+
+	render_target none { render_target::None };
+	if (m_reached_target.compare_exchange_strong(none, reached))
+		points_target_at_target = work_scheduler.close_budget();
+}
+
+// The noise is estimated from the change of the normalized image since a snapshot taken with fewer seeds: with N1 then
+// N2 seeds, the variance of the difference is the variance of the image at N2 times N2 / N1 - 1. Snapshots are taken
+// each time the seeds grew by a quarter, so that the estimate is not too noisy itself and its cost stays negligible
+bool generator::noise_below_target() {
+	std::unique_lock<std::mutex> lock(noise_mutex, std::try_to_lock);
+	if (!lock.owns_lock())
+		return false;
+	Int seeds { seeds_in_image + total_progress().first };
+	if (seeds == 0 || (noise_snapshot_seeds != 0 && seeds < noise_snapshot_seeds + noise_snapshot_seeds / 4))
+		return false;
+
+	merge_replicas();
+	std::vector<float> current(static_cast<size_t>(properties.image_width) * properties.image_height);
+	Real sum { 0. };
+	{
+		std::lock_guard<std::mutex> image_lock(image_ptr_mutex);
+		for (uint16_t y { 0 } ; y < properties.image_height ; y++)
+			for (uint16_t x { 0 } ; x < properties.image_width ; x++) {
+				Int e { image_ptr->read(x, y) };
+				current[x + static_cast<size_t>(properties.image_width) * y] = static_cast<float>(e);
+				sum += e;
+			}
 	}
+	if (sum == 0.)
+		return false;
+	for (float& e : current)
+		e = static_cast<float>(e / sum);
+
+	bool below { false };
+	if (!noise_snapshot.empty()) {
+		Real difference { 0. }, norm { 0. };
+		for (size_t i { 0 } ; i < current.size() ; i++) {
+			Real d { static_cast<Real>(current[i]) - noise_snapshot[i] };
+			difference += d * d;
+			norm += static_cast<Real>(current[i]) * current[i];
+		}
+		Real ratio { static_cast<Real>(seeds) / noise_snapshot_seeds };
+		Real noise { std::sqrt(difference / (ratio - 1.) / norm) };
+		m_noise_estimate = noise;
+		below = noise <= runtime_parameters.noise_target;
+	}
+	noise_snapshot = std::move(current);
+	noise_snapshot_seeds = seeds;
+	return below;
+}
 
-	threads_batch_size[thread_index] = batch_target;
-	return batch_target;
+// Size of the next batch so that it lasts about batch_duration_ms, given how long the last one took. The targets are
+// only checked between batches, so a batch is also cut to the time left of the time budget
+Int generator::next_batch_size(Int batch_size, Int batch_done, double batch_seconds) {
+	if (batch_done == 0 || batch_seconds <= 0.)
+		return batch_size;
+
+	double size { static_cast<double>(batch_size) };
+	if (runtime_parameters.batch_duration_ms != 0) {
+		double target_seconds { runtime_parameters.batch_duration_ms * 1e-3 };
+		double ideal { batch_done * target_seconds / batch_seconds };
+		// change the size progressively, seeds' cost is noisy
+		size = std::clamp(ideal, batch_size * 0.5, batch_size * 2.);
+	}
+	if (runtime_parameters.time_budget_ms != 0) {
+		double seconds_left { (runtime_parameters.time_budget_ms * 1e6 - running_ns()) * 1e-9 };
+		size = std::min(size, batch_done * std::max(seconds_left, 0.) / batch_seconds);
+	}
+	return std::max<Int>(1, static_cast<Int>(size));
 }
 
-void generator::save_progress(size_t thread_index, Int& batch_done, Int& batch_target) {
+void generator::save_progress(size_t thread_index, Int& batch_done) {
 	if (batch_done == 0) // nothing to save
 		return;
 
-	std::lock_guard<std::mutex> lock(access_progress_mutex);
-	pool_points_done += batch_done;
-	total_points_done += batch_done;
-	if (pool_points_done == runtime_parameters.pool_batch_size) // reset the pool progression when the goal was reached
-		pool_points_done = 0;
-
+	// the total is updated before the thread's progress is reset, so the total progress may only overestimate
+	total_points_done.fetch_add(batch_done, std::memory_order_relaxed);
 	batch_done = 0;
-	batch_target = 0;
+	threads_state[thread_index]->points_done.store(0, std::memory_order_relaxed);
+}
+
+// Index-based samplers are shared by all threads through rng_stream, the others draw from the thread's own seed
+std::unique_ptr<sampler> generator::make_sampler(Int sampler_seed) const {
+	auto [seed_a, seed_b] = sampled_seed_domain(properties, parameters);
+	switch (properties.sampler_t) {
+	case sampler_type::Sobol:
+		return std::make_unique<qmc_sampler>(seed_a, seed_b, qmc_sequence::Sobol, properties.rng_stream);
+	case sampler_type::Halton:
+		return std::make_unique<qmc_sampler>(seed_a, seed_b, qmc_sequence::Halton, properties.rng_stream);
+	case sampler_type::R2:
+		return std::make_unique<qmc_sampler>(seed_a, seed_b, qmc_sequence::R2, properties.rng_stream);
+	case sampler_type::ImportanceMap:
+		return std::make_unique<importance_sampler>(seed_a, seed_b, pilot_map, properties.rng_stream);
+	default:
+		break;
+	}
+	if (properties.deterministic)
+		return std::make_unique<index_sampler>(seed_a, seed_b, properties.rng_stream);
+	if (properties.sampler_t == sampler_type::Uniform)
+		return std::make_unique<uniform_sampler>(seed_a, seed_b, sampler_seed);
+	if (shared_tree)
+		return std::make_unique<monte_carlo_sampler>(seed_a, seed_b, shared_tree, sampler_seed);
+	return std::make_unique<monte_carlo_sampler>(seed_a, seed_b, properties.layers, properties.layer_resolution, properties.tree_max_nodes, sampler_seed);
+}
+
+// The proposal's orbit is traced, then the orbit of the chain's current seed, which may be the proposal, is splatted
+// with a weight inversely proportional to its contribution, points_in_view then counts the weight splatted
+void generator::metropolis_step(metropolis_sampler& chain, thread_counters& counters, abstractImage& target_image, std::mutex& target_image_mutex,
+                                pixel_list& current_pixels, pixel_list& proposal_pixels) {
+	std::complex<Real> z0 { chain.propose() };
+	proposal_pixels.clear();
+	if (insideCardioids(z0))
+		thread_counters::add(counters.cardioid_rejects, 1);
+	else {
+		Int i { escape_iterations(z0, parameters.iterations_to_escape, parameters.escape_norm) };
+		if (i == parameters.iterations_to_escape || i < parameters.minimum_iterations)
+			thread_counters::add(i == parameters.iterations_to_escape ? counters.non_escaping_rejects : counters.below_minimum_rejects, 1);
+		else {
+			Real real_m = properties.corner_a.real();
+			Real real_M = properties.corner_b.real();
+			Real imag_m = properties.corner_a.imag();
+			Real imag_M = properties.corner_b.imag();
 
-	threads_points_done[thread_index] = 0;
-	threads_batch_size[thread_index] = 0;
+			auto plot = [&](Real re, Real im) {
+				if (re < real_m || real_M <= re || im < imag_m || imag_M <= im)
+					return;
+				uint16_t x = (re - real_m) / (real_M - real_m) * static_cast<Real>(properties.image_width);
+				uint16_t y = (im - imag_m) / (imag_M - imag_m) * static_cast<Real>(properties.image_height);
+				proposal_pixels.emplace_back(x, y);
+			};
+			std::complex<Real> z { z0 };
+			for (Int k { 0 } ; k < i ; k++, z = z * z + z0) {
+				plot(z.real(), z.imag());
+				if (parameters.y_symetry)
+					plot(z.real(), -z.imag());
+			}
+			thread_counters::add(counters.accepted_orbits, 1);
+			thread_counters::add(counters.orbit_points, i);
+			if (proposal_pixels.empty())
+				thread_counters::add(counters.missed_view_orbits, 1);
+		}
+	}
+
+	if (chain.accept(proposal_pixels.size()))
+		std::swap(current_pixels, proposal_pixels);
+	if (current_pixels.empty())
+		return;
+
+	Int whole { chain.whole_weight() };
+	Int extra { chain.extra_points() };
+	auto lock { timed_lock(target_image_mutex, counters.lock_wait_ns) };
+	if (whole != 0)
+		for (auto [x, y] : current_pixels)
+			target_image.add(x, y, whole);
+	for (Int k { 0 } ; k < extra ; k++) {
+		auto [x, y] = current_pixels[chain.pick_point()];
+		target_image.incr(x, y);
+	}
+	thread_counters::add(counters.points_in_view, metropolis_sampler::splat_weight);
 }
 
 void generator::task(size_t thread_index) {
 	using namespace std::chrono_literals;
 
-	monte_carlo_sampler sampler(properties.corner_a, properties.corner_b, properties.layers, properties.layer_resolution);
+	thread_state& state { *threads_state[thread_index] };
+	thread_counters& counters { state.counters };
+	worker_context& context { *state.context };
+	// pin before allocating anything, so that the worker's buffers are first touched on its node. The thread of the
+	// pool may have been pinned by the job of another worker
+	if (state.pinned)
+		pin_current_thread(state.cpu);
+	else
+		unpin_current_thread(topology);
+
+	abstractImage* target_image { image_ptr.get() };
+	std::mutex* target_image_mutex { &image_ptr_mutex };
+	if (state.pinned && !replicas.empty() && replicas[state.node]) {
+		target_image = replicas[state.node]->img.get();
+		target_image_mutex = &replicas[state.node]->mutex;
+	}
+
+	if (!context.prepared) {
+		if (properties.sampler_t == sampler_type::MetropolisHastings) {
+			auto [seed_a, seed_b] = sampled_seed_domain(properties, parameters);
+			context.chain = std::make_unique<metropolis_sampler>(properties.corner_a, properties.corner_b, seed_a, seed_b, context.sampler_seed);
+		}
+		else
+			context.seed_sampler = make_sampler(context.sampler_seed);
+		context.batch_size = std::max<Int>(1, runtime_parameters.thread_batch_size);
+		context.band_blocks.assign(bands.size(), nullptr);
+		context.prepared = true;
+	}
+	std::unique_ptr<metropolis_sampler>& chain { context.chain };
+	pixel_list& current_pixels { context.current_pixels };
+	pixel_list& proposal_pixels { context.proposal_pixels };
+	std::unique_ptr<sampler>& seed_sampler { context.seed_sampler };
 
 	// // setup random generator
 	// std::random_device rd;
@@ -164,78 +710,162 @@ void generator::task(size_t thread_index) {
 	// std::uniform_real_distribution<Real> real_distrib(real_m, real_M);
 	// std::uniform_real_distribution<Real> imag_distrib(imag_m, imag_M);
 
-	bool must_request_batch { true };
-	Int batch_target { 0 };
-	Int batch_done   { 0 };
-	std::vector<std::complex<Real>> seq;
-	seq.reserve(parameters.iterations_to_escape);
+	Int& batch_size { context.batch_size };
+	Int& batch_done { context.batch_done };
+	auto batch_start { std::chrono::steady_clock::now() };
+	Int index;
+	sample_result sample;
+	seed_range& seeds { context.seeds };
+	// seeds are drawn by blocks, whose bounded seeds are rejected at once: only the survivors come out of next_seed.
+	// The chain draws its own proposals, so it only needs indices
+	seed_block& block { context.block };
+	// taking indices by small chunks keeps the queue's lock out of the per-seed path while letting other threads steal most of the batch
+	auto next_seed = [&]{
+		for (;;) {
+			if (chain && !seeds.empty()) {
+				index = seeds.begin++;
+				return true;
+			}
+			if (!chain) {
+				Int skipped;
+				bool found { block.next(parameters.iterations_to_escape, index, sample, skipped) };
+				if (skipped != 0) {
+					batch_done += skipped;
+					state.points_done.store(batch_done, std::memory_order_relaxed);
+					thread_counters::add(counters.seeds, skipped);
+					thread_counters::add(counters.cardioid_rejects, skipped);
+				}
+				if (found)
+					return true;
+			}
+			if (seeds.empty())
+				seeds = work_scheduler.take(thread_index, std::max<Int>(1, batch_size / 16));
+			if (seeds.empty())
+				return false;
+			if (!chain) {
+				seed_range r { seeds.begin, std::min<Int>(seeds.end, seeds.begin + std::min(seed_block::capacity, seed_sampler->lookahead())) };
+				seeds.begin = r.end;
+				block.fill(*seed_sampler, r);
+			}
+		}
+	};
+	// points of the orbit being traced, scattered to the image when the buffer is full. It stays in the L1 cache and
+	// its size does not depend on iterations_to_escape
+	constexpr size_t scatter_chunk { 1024 };
+	pixel_list& pixels { context.pixels };
+	pixels.reserve(scatter_chunk);
+	// accepted seeds are appended to the cache by buffers, to keep its lock out of the per-seed path
+	std::vector<cached_seed>& recorded { context.recorded };
+	auto flush_recorded = [&]{
+		if (!recorded.empty())
+			seed_recorder.load(std::memory_order_acquire)->append(recorded);
+		recorded.clear();
+	};
+	// with scatter threads, pixels are queued to the thread owning their band instead of being applied to the image.
+	// The block being filled for each band is only published when full, or when the thread stops iterating
+	std::vector<pixel_queue::block*>& band_blocks { context.band_blocks };
+	auto queue_pixels = [&](Int weight){
+		for (auto [x, y] : pixels) {
+			size_t b { band_of_row[y] };
+			pixel_queue& queue { *bands[b]->queues[thread_index] };
+			pixel_queue::block*& block { band_blocks[b] };
+			if (!block && !(block = queue.writable())) {
+				auto start { std::chrono::steady_clock::now() };
+				while (!(block = queue.writable()))
+					std::this_thread::yield();
+				std::chrono::nanoseconds waited { std::chrono::steady_clock::now() - start };
+				thread_counters::add(counters.lock_wait_ns, waited.count());
+			}
+			uint32_t offset { x + static_cast<uint32_t>(properties.image_width) * (y - bands[b]->first_row) };
+			block->entries[block->size++] = { offset, static_cast<uint32_t>(weight) };
+			if (block->size == pixel_queue::block_entries) {
+				queue.publish();
+				block = nullptr;
+			}
+		}
+		pixels.clear();
+	};
+	auto publish_blocks = [&]{
+		for (size_t b { 0 } ; b < band_blocks.size() ; b++) {
+			if (band_blocks[b])
+				bands[b]->queues[thread_index]->publish();
+			band_blocks[b] = nullptr;
+		}
+	};
+
+	// the job starts when the generator is resumed, and leaves the thread to the pool when it is paused or stopped
+	goto running_state;
 
 paused_state:
-	std::this_thread::sleep_for(100ms);
-	if (m_order == order::Run)
+	flush_recorded();
+	publish_blocks();
+	if (!leave_job(state))
 		goto running_state;
-	if (m_order == order::Stop)
-		goto stopped_state;
-	goto paused_state;
+	return;
 
 
 running_state:
-	while (batch_done == batch_target && (batch_target = request_batch(thread_index)) == 0) {
-		std::this_thread::sleep_for(1s); // wait
+	while (!next_seed()) {
+		publish_blocks();
+		// batch finished (or never started), save points processed, adapt the batch size and request a new batch
+		std::chrono::duration<double> batch_seconds { std::chrono::steady_clock::now() - batch_start };
+		batch_size = next_batch_size(batch_size, batch_done, batch_seconds.count());
+		bool finished_batch { batch_done != 0 };
+		save_progress(thread_index, batch_done);
+		if (finished_batch)
+			check_targets();
+		if (finished_batch && m_order == order::FinishBatch)
+			goto paused_state;
 
-		if (m_order == order::Pause)
+		Int new_batch { work_scheduler.refill(thread_index, batch_size) };
+		state.batch_size.store(new_batch, std::memory_order_relaxed);
+		batch_start = std::chrono::steady_clock::now();
+		if (new_batch != 0)
+			continue;
+		if (m_reached_target != render_target::None)
+			goto paused_state;
+
+		std::this_thread::sleep_for(100ms); // no work left, wait
+
+		if (m_order == order::Pause || m_order == order::Stop)
 			goto paused_state;
-		if (m_order == order::Stop)
-			goto stopped_state;
 	}
-	// batch requested with success
 
 	// iterate on batch points
-	while (batch_done < batch_target) {
-		if (m_order == order::Pause)
-			goto paused_state;
-		if (m_order == order::Stop)
-			goto stopped_state;
+	do {
 
 		// process one point
-		sample_result sample;
-		{
-			std::lock_guard<std::mutex> lock(sample_mutex);
-			sample = sampler.sample();
-		}
-		std::complex<Real> z0 = sample.sample;
-		if (insideCardioids(z0)) {
-			sample.feedback_result(0, parameters.iterations_to_escape);
+		batch_done++;
+		state.points_done.store(batch_done, std::memory_order_relaxed);
+		thread_counters::add(counters.seeds, 1);
+		if (chain) {
+			metropolis_step(*chain, counters, *target_image, *target_image_mutex, current_pixels, proposal_pixels);
 			continue;
 		}
 
-		seq.clear();
-		Int i = 0;
-		std::complex<Real> z = z0;
+		std::complex<Real> z0 = sample.sample;
 
-		for ( ; i < parameters.iterations_to_escape && std::norm(z) < parameters.escape_norm ; i++) {
-			z = z * z + z0;
-		}
+		Int i = escape_iterations(z0, parameters.iterations_to_escape, parameters.escape_norm);
 
 		// the sequence didn't escaped before the limit : it is not taken into account
 		if (i == parameters.iterations_to_escape || i < parameters.minimum_iterations) {
 			sample.feedback_result(0, parameters.iterations_to_escape);
+			thread_counters::add(i == parameters.iterations_to_escape ? counters.non_escaping_rejects : counters.below_minimum_rejects, 1);
 			continue;
 		}
-
-		z = z0;
-		for (i = 0 ; i < parameters.iterations_to_escape && std::norm(z) < parameters.escape_norm ; i++) {
-			seq.push_back(z);
-			z = z * z + z0;
-		}
-
-		if (i == 0 && std::norm(z) >= parameters.escape_norm) {
+		if (i == 0) {
 			// if the sample z0 is out of the norm at the first iteration, penalize the monte carlo tree
 			sample.feedback_result(0, parameters.iterations_to_escape);
+			thread_counters::add(counters.below_minimum_rejects, 1);
 			continue;
 		}
+		if (seed_recorder.load(std::memory_order_acquire) && i <= UINT32_MAX) {
+			recorded.push_back({ z0, static_cast<uint32_t>(i) });
+			if (recorded.size() >= 4096)
+				flush_recorded();
+		}
 
-		// apply the sequence to the image and feedback the result to the sampler
+		// trace the orbit again, and apply it to the image by chunks of pixels, then feedback the result to the sampler
 		{
 			Int successful_points = 0;
 
@@ -245,40 +875,117 @@ running_state:
 			Real imag_m = properties.corner_a.imag();
 			Real imag_M = properties.corner_b.imag();
 
-			std::lock_guard<std::mutex> lock(image_ptr_mutex);
-			std::for_each(seq.begin(), seq.end(), [&](auto z){
-				if (z.real() < real_m
-				||	real_M < z.real()
-				||	z.imag() < imag_m
-				||	imag_M < z.imag())
+			auto flush_pixels = [&]{
+				if (!bands.empty()) {
+					queue_pixels(sample.weight);
+					return;
+				}
+				auto lock { timed_lock(*target_image_mutex, counters.lock_wait_ns) };
+				if (sample.weight == 1)
+					for (auto [x, y] : pixels)
+						target_image->incr(x, y);
+				else
+					for (auto [x, y] : pixels)
+						target_image->add(x, y, sample.weight);
+				pixels.clear();
+			};
+			// the view is half-open, so that the right and top edges do not map to the pixel past the last one
+			auto plot = [&](Real re, Real im) {
+				if (re < real_m
+				||	real_M <= re
+				||	im < imag_m
+				||	imag_M <= im)
 					return;
 
-				uint16_t x = (z.real() - real_m) / (real_M - real_m) * static_cast<Real>(properties.image_width);
-				uint16_t y = (z.imag() - imag_m) / (imag_M - imag_m) * static_cast<Real>(properties.image_height);
+				uint16_t x = (re - real_m) / (real_M - real_m) * static_cast<Real>(properties.image_width);
+				uint16_t y = (im - imag_m) / (imag_M - imag_m) * static_cast<Real>(properties.image_height);
 
-				image_ptr->incr(x, y);
+				pixels.emplace_back(x, y);
 				successful_points++;
-
-				if (parameters.y_symetry) {
-					uint16_t sym_y = properties.image_height - y - 1; // y is in [0, height-1], so -1 to get the result into [0,height-1] and avoid out of range
-					if (sym_y != y)		// avoid increasing twice the center line if the image has an odd height
-						image_ptr->incr(x, sym_y);
-				}
-			});
+				if (pixels.size() == scatter_chunk)
+					flush_pixels();
+			};
+
+			std::complex<Real> z = z0;
+			for (Int k = 0 ; k < i ; k++, z = z * z + z0) {
+				plot(z.real(), z.imag());
+				// the conjugate orbit, which is not sampled when the seed domain is halved
+				if (parameters.y_symetry)
+					plot(z.real(), -z.imag());
+			}
+			if (!pixels.empty())
+				flush_pixels();
 
 			sample.feedback_result(successful_points, parameters.iterations_to_escape);
+			thread_counters::add(counters.accepted_orbits, 1);
+			thread_counters::add(counters.orbit_points, i);
+			if (successful_points == 0)
+				thread_counters::add(counters.missed_view_orbits, 1);
+			thread_counters::add(counters.points_in_view, successful_points);
 		}
-		batch_done++;
-		threads_points_done[thread_index] = batch_done;
-	}
+	} while (m_order != order::Pause && m_order != order::Stop && next_seed());
 
-	// batch finished, save points processed, reset progress and request new batch
-	save_progress(thread_index, batch_done, batch_target);
-	if (m_order == order::FinishBatch)
+	if (m_order == order::Pause || m_order == order::Stop)
 		goto paused_state;
 	goto running_state;
+}
 
-
-stopped_state:
-	save_progress(thread_index, batch_done, batch_target);
-}
\ No newline at end of file
+// Applies the pixels queued by the iteration threads to the band's own counters, which are only added to the image
+// from time to time, so that the image's lock stays out of the per-pixel path
+void generator::scatter_task(size_t band_index) {
+	using namespace std::chrono_literals;
+	constexpr auto flush_period { 100ms };
+
+	scatter_band& band { *bands[band_index] };
+	const uint16_t width { properties.image_width };
+	// allocated by this thread, so that its pages are first touched on the thread's node
+	std::vector<Int> counts(static_cast<size_t>(width) * (band.end_row - band.first_row), 0);
+	bool dirty { false };
+	auto last_flush { std::chrono::steady_clock::now() };
+	auto flush = [&]{
+		std::lock_guard<std::mutex> lock(image_ptr_mutex);
+		for (size_t i { 0 } ; i < counts.size() ; i++) {
+			if (counts[i] == 0)
+				continue;
+			image_ptr->add(i % width, band.first_row + i / width, counts[i]);
+			counts[i] = 0;
+		}
+		dirty = false;
+		last_flush = std::chrono::steady_clock::now();
+	};
+
+	// true if any block was applied
+	auto drain = [&]{
+		bool applied { false };
+		for (auto& queue : band.queues) {
+			for (pixel_queue::block* block ; (block = queue->readable()) != nullptr ; queue->release()) {
+				for (size_t k { 0 } ; k < block->size ; k++)
+					counts[block->entries[k].offset] += block->entries[k].weight;
+				applied = true;
+			}
+		}
+		return applied;
+	};
+
+	for (;;) {
+		bool idle { !drain() };
+		dirty |= !idle;
+		if (dirty && std::chrono::steady_clock::now() - last_flush >= flush_period)
+			flush();
+		if (!idle)
+			continue;
+		{
+			// once the iteration jobs have left, nothing is queued until the generator is resumed, under the same lock
+			std::lock_guard<std::mutex> lock(workers_mutex);
+			if (active_workers == 0) {
+				drain();
+				flush();
+				band.running = false;
+				active_scatters--;
+				workers_done.notify_all();
+				return;
+			}
+		}
+		std::this_thread::sleep_for(500us);
+	}
+}
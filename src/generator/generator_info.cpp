@@ -1,5 +1,9 @@
 #include "generator/generator_info.h"
 
+#include <cinttypes>
+#include <cstdio>
+#include <string>
+
 std::string_view status_to_string(status s) {
 	switch (s) {
 	case status::Running:
@@ -13,4 +17,110 @@ std::string_view status_to_string(status s) {
 	default:
 		return "No string for this status";
 	}
+}
+
+std::string_view affinity_to_string(thread_affinity a) {
+	switch (a) {
+	case thread_affinity::None:
+		return "None";
+	case thread_affinity::Compact:
+		return "Compact";
+	case thread_affinity::Scatter:
+		return "Scatter";
+	case thread_affinity::CoreList:
+		return "Core list";
+	default:
+		return "No string for this affinity";
+	}
+}
+
+std::string_view sampler_to_string(sampler_type s) {
+	switch (s) {
+	case sampler_type::Uniform:
+		return "Uniform";
+	case sampler_type::MonteCarlo:
+		return "Monte Carlo";
+	case sampler_type::Sobol:
+		return "Sobol";
+	case sampler_type::Halton:
+		return "Halton";
+	case sampler_type::R2:
+		return "R2";
+	case sampler_type::MetropolisHastings:
+		return "Metropolis-Hastings";
+	case sampler_type::ImportanceMap:
+		return "Importance map";
+	default:
+		return "No string for this sampler";
+	}
+}
+
+std::string_view target_to_string(render_target t) {
+	switch (t) {
+	case render_target::None:
+		return "None";
+	case render_target::TimeBudget:
+		return "Time budget";
+	case render_target::AcceptedOrbits:
+		return "Accepted orbits";
+	case render_target::Noise:
+		return "Noise";
+	default:
+		return "No string for this target";
+	}
+}
+
+bool samples_by_index(sampler_type s) {
+	return s == sampler_type::Sobol || s == sampler_type::Halton || s == sampler_type::R2 || s == sampler_type::ImportanceMap;
+}
+
+// With y_symetry, the orbits of the lower half of a symmetric seed domain are the conjugates of the upper half's ones
+std::pair<std::complex<Real>, std::complex<Real>> sampled_seed_domain(const generator_properties& properties, const generator_parameters& parameters) {
+	std::complex<Real> seed_a { properties.seed_corner_a }, seed_b { properties.seed_corner_b };
+	if (parameters.y_symetry && seed_a.imag() == -seed_b.imag())
+		(seed_a.imag() < seed_b.imag() ? seed_a : seed_b).imag(0.);
+	return { seed_a, seed_b };
+}
+
+generator_stats& generator_stats::operator+=(const generator_stats& other) {
+	seeds += other.seeds;
+	cardioid_rejects += other.cardioid_rejects;
+	non_escaping_rejects += other.non_escaping_rejects;
+	below_minimum_rejects += other.below_minimum_rejects;
+	accepted_orbits += other.accepted_orbits;
+	missed_view_orbits += other.missed_view_orbits;
+	orbit_points += other.orbit_points;
+	points_in_view += other.points_in_view;
+	lock_wait_ns += other.lock_wait_ns;
+	return *this;
+}
+
+generator_stats& generator_stats::operator-=(const generator_stats& other) {
+	seeds -= other.seeds;
+	cardioid_rejects -= other.cardioid_rejects;
+	non_escaping_rejects -= other.non_escaping_rejects;
+	below_minimum_rejects -= other.below_minimum_rejects;
+	accepted_orbits -= other.accepted_orbits;
+	missed_view_orbits -= other.missed_view_orbits;
+	orbit_points -= other.orbit_points;
+	points_in_view -= other.points_in_view;
+	lock_wait_ns -= other.lock_wait_ns;
+	return *this;
+}
+
+// One line summary of counters accumulated during `seconds`, rates are given per second
+std::string stats_to_string(const generator_stats& stats, double seconds) {
+	auto rate = [&](Int value) { return seconds > 0. ? value / seconds : 0.; };
+	auto ratio = [&](Int value) { return stats.seeds ? 100. * value / stats.seeds : 0.; };
+
+	char buffer[512];
+	std::snprintf(buffer, sizeof(buffer),
+		"seeds %" PRIu64 " (%.0f/s) | rejected: cardioid %.1f%%, non-escaping %.1f%%, below minimum %.1f%% | accepted %" PRIu64 " (%.0f/s, %.1f%% missing the view) | orbit points %.0f/s, in view %.0f/s | lock wait %.3f s",
+		stats.seeds, rate(stats.seeds),
+		ratio(stats.cardioid_rejects), ratio(stats.non_escaping_rejects), ratio(stats.below_minimum_rejects),
+		stats.accepted_orbits, rate(stats.accepted_orbits),
+		stats.accepted_orbits ? 100. * stats.missed_view_orbits / stats.accepted_orbits : 0.,
+		rate(stats.orbit_points), rate(stats.points_in_view),
+		stats.lock_wait_ns * 1e-9);
+	return buffer;
 }
\ No newline at end of file
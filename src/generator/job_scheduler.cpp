@@ -0,0 +1,407 @@
+#include "generator/job_scheduler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <thread>
+#include <type_traits>
+
+#include "image/shard.h"
+
+namespace {
+	constexpr char magic[8] { 'B', 'B', 'J', 'O', 'B', '\0', '\0', '\0' };
+	constexpr uint32_t version { 1 };
+	// a job keeps its threads until it received this many thread-seconds more than a waiting job of the same
+	// priority, so that jobs do not swap at every update when there are more jobs than threads
+	constexpr double time_slice_seconds { 10. };
+	// on shutdown, the deterministic jobs which do not finish the seeds handed out by then keep their last checkpoint
+	constexpr std::chrono::seconds drain_timeout { 10 };
+
+	// Fields of a job file which are not in the shard header, followed by the header of its properties and parameters
+	struct saved_job {
+		Int points_target;
+		Int time_budget_ms;
+		Int accepted_orbits_target;
+		Real noise_target;
+		Int priority;
+		Real share;
+		Int running_ms;
+		bool finished;
+		render_target reached;
+		Int rng_stream;
+		Int tree_max_nodes;
+		bool shared_tree;
+		Real tree_decay;
+		Int pilot_resolution;
+		Int pilot_seeds;
+	};
+	static_assert(std::is_trivially_copyable_v<saved_job>, "jobs are saved as raw bytes");
+
+	Int remaining(Int target, Int done) {
+		return target == 0 ? 0 : std::max<Int>(1, target - std::min(target, done));
+	}
+}
+
+std::string_view job_state_to_string(job_state s) {
+	switch (s) {
+	case job_state::Queued:    return "Queued";
+	case job_state::Running:   return "Running";
+	case job_state::Preempted: return "Preempted";
+	case job_state::Finished:  return "Finished";
+	default:                   return "Unknown";
+	}
+}
+
+job_scheduler::job_scheduler(const std::string& directory_in, const generator_runtime_parameters& runtime_parameters_in) {
+	directory = directory_in;
+	runtime_parameters = runtime_parameters_in;
+	// the scheduler accounts for every thread of the jobs, so they all iterate
+	runtime_parameters.scatter_threads = 0;
+	last_update = std::chrono::steady_clock::now();
+}
+
+job_scheduler::~job_scheduler() {
+	using namespace std::chrono_literals;
+	// a deterministic job saved with gaps in its seeds could not go on from the next one
+	for (auto& j : queue)
+		if (j->gen && j->gen->properties.deterministic) {
+			if (!j->draining)
+				start_drain(*j);
+			j->gen->resume();
+		}
+	auto deadline { std::chrono::steady_clock::now() + drain_timeout };
+	for (auto& j : queue)
+		while (j->draining && !finished(*j) && std::chrono::steady_clock::now() < deadline)
+			std::this_thread::sleep_for(10ms);
+
+	for (auto& j : queue)
+		if (j->gen) {
+			bool complete { !j->draining || finished(*j) };
+			j->gen->stop();
+			if (complete)
+				save_job(*j);
+		}
+}
+
+std::string job_scheduler::job_path(const job& j) const {
+	return directory + "/" + j.description.name + ".job";
+}
+
+std::string job_scheduler::shard_path(const job& j) const {
+	return directory + "/" + j.description.name + ".shard";
+}
+
+bool job_scheduler::submit(const job_description& description) {
+	const std::string& name { description.name };
+	if (name.empty() || name.find('/') != std::string::npos || description.share <= 0.)
+		return false;
+	for (auto& j : queue)
+		if (j->description.name == name)
+			return false;
+
+	auto j { std::make_unique<job>() };
+	j->description = description;
+	j->first_seed_index = description.properties.first_seed_index;
+	if (std::ifstream(job_path(*j)) || !save_job(*j))
+		return false;
+	queue.push_back(std::move(j));
+	return true;
+}
+
+void job_scheduler::load() {
+	std::error_code error;
+	for (auto& entry : std::filesystem::directory_iterator(directory, error)) {
+		if (entry.path().extension() != ".job")
+			continue;
+		std::string name { entry.path().stem().string() };
+		if (std::none_of(queue.begin(), queue.end(), [&](auto& j){ return j->description.name == name; }))
+			load_job(name);
+	}
+}
+
+bool job_scheduler::load_job(const std::string& name) {
+	auto j { std::make_unique<job>() };
+	j->description.name = name;
+
+	std::ifstream file(job_path(*j), std::ios::binary);
+	char file_magic[sizeof(magic)];
+	uint32_t file_version;
+	saved_job saved;
+	shard_header header;
+	file.read(file_magic, sizeof(file_magic));
+	file.read(reinterpret_cast<char*>(&file_version), sizeof(file_version));
+	file.read(reinterpret_cast<char*>(&saved), sizeof(saved));
+	if (!file || std::memcmp(file_magic, magic, sizeof(magic)) != 0 || file_version != version || !read_shard_header(file, header))
+		return false;
+
+	job_description& d { j->description };
+	d.properties = header.properties;
+	d.parameters = header.parameters;
+	d.properties.rng_stream       = saved.rng_stream;
+	d.properties.tree_max_nodes   = saved.tree_max_nodes;
+	d.properties.shared_tree      = saved.shared_tree;
+	d.properties.tree_decay       = saved.tree_decay;
+	d.properties.pilot_resolution = saved.pilot_resolution;
+	d.properties.pilot_seeds      = saved.pilot_seeds;
+	d.points_target               = saved.points_target;
+	d.time_budget_ms              = saved.time_budget_ms;
+	d.accepted_orbits_target      = saved.accepted_orbits_target;
+	d.noise_target                = saved.noise_target;
+	d.priority                    = saved.priority;
+	d.share                       = saved.share;
+	j->running_ms_before = saved.running_ms;
+	j->state = saved.finished ? job_state::Finished : job_state::Queued;
+	j->reached = saved.reached;
+	j->first_seed_index = d.properties.first_seed_index;
+
+	// the progress is the one of the histogram, which may be older than the job file
+	shard_reader reader;
+	if (reader.open(shard_path(*j))) {
+		j->stats_before = reader.header().stats;
+		j->streams_before = reader.header().streams;
+		j->first_seed_index = reader.header().properties.first_seed_index;
+		d.properties.deterministic = reader.header().properties.deterministic;
+	}
+	queue.push_back(std::move(j));
+	return true;
+}
+
+bool job_scheduler::save_job(job& j) {
+	const job_description& d { j.description };
+	shard_header header { d.properties, d.parameters, {}, {} };
+	if (j.gen) {
+		// the histogram is written first, a job file newer than its shard only loses some running time
+		j.gen->merge_replicas();
+		shard_header progress { j.gen->properties, j.gen->parameters, stats(j), j.streams_before };
+		progress.properties.first_seed_index = j.first_seed_index;
+		if (progress.properties.deterministic)
+			progress.streams = { j.gen->properties.rng_stream };
+		else
+			progress.streams.push_back(j.gen->properties.rng_stream);
+		std::string path { shard_path(j) };
+		std::string temporary { path + ".tmp" };
+		if (!write_shard(temporary, progress, *j.img) || std::rename(temporary.c_str(), path.c_str()) != 0)
+			return false;
+		header.properties.deterministic = progress.properties.deterministic;
+	}
+
+	saved_job saved { d.points_target, d.time_budget_ms, d.accepted_orbits_target, d.noise_target, d.priority, d.share,
+	                  running_ms(j), j.state == job_state::Finished, j.reached, d.properties.rng_stream,
+	                  d.properties.tree_max_nodes, d.properties.shared_tree, d.properties.tree_decay,
+	                  d.properties.pilot_resolution, d.properties.pilot_seeds };
+	std::string path { job_path(j) };
+	std::string temporary { path + ".tmp" };
+	std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+	file.write(magic, sizeof(magic));
+	file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+	file.write(reinterpret_cast<const char*>(&saved), sizeof(saved));
+	write_shard_header(file, header);
+	file.close();
+	return !file.fail() && std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+// A job started again goes on with seeds distinct from those of its histogram: the next indices of a deterministic
+// render, or a new stream otherwise. Its targets are what is left of them
+void job_scheduler::start(job& j) {
+	const job_description& d { j.description };
+	j.img = std::make_shared<image>(d.properties.image_width, d.properties.image_height);
+	generator_properties properties { d.properties };
+	generator_parameters parameters { d.parameters };
+
+	shard_reader reader;
+	if (j.stats_before.seeds != 0 && reader.open(shard_path(j))) {
+		std::vector<Int> row(properties.image_width);
+		for (uint16_t y { 0 } ; y < properties.image_height && reader.read_rows(row.data(), 1) ; y++)
+			for (uint16_t x { 0 } ; x < properties.image_width ; x++)
+				j.img->set(x, y, row[x]);
+		if (properties.deterministic) {
+			properties.first_seed_index = j.first_seed_index + j.stats_before.seeds;
+			properties.rng_stream = j.streams_before.empty() ? properties.rng_stream : j.streams_before.front();
+		}
+		else
+			properties.rng_stream = 0;
+	}
+	else
+		j.stats_before = {};
+
+	generator_runtime_parameters job_parameters { runtime_parameters };
+	job_parameters.threads_number = j.threads;
+	job_parameters.points_target = remaining(d.points_target, j.stats_before.seeds);
+	job_parameters.time_budget_ms = remaining(d.time_budget_ms, j.running_ms_before);
+	job_parameters.accepted_orbits_target = remaining(d.accepted_orbits_target, j.stats_before.accepted_orbits);
+	job_parameters.noise_target = d.noise_target;
+	j.gen = std::make_unique<generator>(j.img, properties, parameters, job_parameters);
+	j.gen->set_seeds_in_image(j.stats_before.seeds);
+	j.gen->resume();
+}
+
+// A reached target becomes the points target of the generator, so a job only finishes once the seeds handed out
+// before it are done, and the shard of a deterministic job has no gap
+bool job_scheduler::finished(job& j) {
+	if (!j.gen)
+		return false;
+	auto [done, target] = j.gen->total_progress();
+	return target != 0 && done >= target;
+}
+
+void job_scheduler::finish(job& j) {
+	j.gen->stop();
+	j.reached = j.gen->reached_target();
+	j.state = job_state::Finished;
+	j.threads = 0;
+	save_job(j);
+	// only the progress is kept, the histogram is in the shard
+	j.stats_before = stats(j);
+	j.running_ms_before = running_ms(j);
+	j.gen.reset();
+	j.img.reset();
+}
+
+// The histogram of a deterministic job must cover the seeds from its first one, so that it goes on from the next one
+// after a crash: the seeds handed out are finished, then update() saves the job, which goes on
+void job_scheduler::start_drain(job& j) {
+	j.points_target_after_drain = j.gen->runtime_parameters.points_target;
+	j.gen->finish_handed_out_seeds();
+	j.draining = true;
+}
+
+bool job_scheduler::end_drain(job& j, bool save) {
+	bool res { !save || save_job(j) };
+	j.gen->set_points_target(j.points_target_after_drain);
+	j.draining = false;
+	return res;
+}
+
+generator_stats job_scheduler::stats(const job& j) const {
+	generator_stats res { j.stats_before };
+	if (j.gen)
+		res += j.gen->stats();
+	return res;
+}
+
+Int job_scheduler::running_ms(const job& j) const {
+	return j.running_ms_before + (j.gen ? j.gen->running_ms() : 0);
+}
+
+// Each of the least served jobs gets a thread, then the others go one by one to the job furthest below its share
+std::vector<uint32_t> job_scheduler::share_threads(std::vector<job*>& candidates) {
+	auto served = [](const job* j){
+		return j->thread_seconds / j->description.share - (j->threads != 0 ? time_slice_seconds : 0.);
+	};
+	std::stable_sort(candidates.begin(), candidates.end(), [&](const job* a, const job* b){ return served(a) < served(b); });
+
+	uint32_t threads { runtime_parameters.threads_number };
+	size_t running { std::min<size_t>(candidates.size(), threads) };
+	Real total_share { 0. };
+	for (size_t i { 0 } ; i < running ; i++)
+		total_share += candidates[i]->description.share;
+
+	std::vector<uint32_t> res(candidates.size(), 0);
+	std::fill(res.begin(), res.begin() + running, 1);
+	for (uint32_t given { static_cast<uint32_t>(running) } ; given < threads ; given++) {
+		size_t furthest { 0 };
+		Real furthest_deficit { std::numeric_limits<Real>::lowest() };
+		for (size_t i { 0 } ; i < running ; i++) {
+			Real deficit { threads * candidates[i]->description.share / total_share - res[i] };
+			if (deficit > furthest_deficit) {
+				furthest = i;
+				furthest_deficit = deficit;
+			}
+		}
+		res[furthest]++;
+	}
+	return res;
+}
+
+bool job_scheduler::update() {
+	auto now { std::chrono::steady_clock::now() };
+	std::chrono::duration<double> elapsed { now - last_update };
+	last_update = now;
+	for (auto& j : queue)
+		j->thread_seconds += j->threads * elapsed.count();
+
+	// the saves started by save() whose seeds are done, before the targets of the jobs are checked again
+	for (auto& j : queue)
+		if (j->draining && finished(*j))
+			drained_saves_ok = end_drain(*j, true) && drained_saves_ok;
+	for (auto& j : queue)
+		if (finished(*j))
+			finish(*j);
+
+	// only the jobs of the highest priority left run, the others are preempted
+	std::vector<job*> candidates;
+	for (auto& j : queue)
+		if (j->state != job_state::Finished
+		&& (candidates.empty() || j->description.priority >= candidates.front()->description.priority)) {
+			if (!candidates.empty() && j->description.priority > candidates.front()->description.priority)
+				candidates.clear();
+			candidates.push_back(j.get());
+		}
+	if (candidates.empty())
+		return false;
+	std::vector<uint32_t> threads { share_threads(candidates) };
+
+	for (auto& j : queue)
+		if (j->state != job_state::Finished && std::find(candidates.begin(), candidates.end(), j.get()) == candidates.end())
+			threads.push_back(0), candidates.push_back(j.get());
+	for (size_t i { 0 } ; i < candidates.size() ; i++) {
+		job& j { *candidates[i] };
+		if (threads[i] == 0) {
+			if (j.gen) {
+				// a paused job would not finish its seeds, it keeps its last checkpoint
+				if (j.draining)
+					end_drain(j, false);
+				j.gen->pause();
+				j.state = job_state::Preempted;
+			}
+			j.threads = 0;
+			continue;
+		}
+		if (!j.gen) {
+			j.threads = threads[i];
+			start(j);
+		}
+		else {
+			if (j.threads != threads[i]) {
+				j.threads = threads[i];
+				generator_runtime_parameters job_parameters { j.gen->runtime_parameters };
+				job_parameters.threads_number = j.threads;
+				j.gen->set_runtime_parameters(job_parameters);
+			}
+			j.gen->resume();
+		}
+		j.state = job_state::Running;
+	}
+	return true;
+}
+
+// Running deterministic jobs are only saved by a later update, so that the caller goes on meanwhile. A preempted one
+// gave back the seeds it was processing, it keeps its last checkpoint
+bool job_scheduler::save() {
+	bool res { drained_saves_ok };
+	drained_saves_ok = true;
+	for (auto& j : queue) {
+		if (!j->gen || j->draining)
+			continue;
+		if (!j->gen->properties.deterministic)
+			res = save_job(*j) && res;
+		else if (j->state == job_state::Running)
+			start_drain(*j);
+	}
+	return res;
+}
+
+void job_scheduler::set_threads(uint32_t threads) {
+	runtime_parameters.threads_number = std::max<uint32_t>(1, threads);
+}
+
+std::vector<job_info> job_scheduler::jobs() {
+	std::vector<job_info> res;
+	for (auto& j : queue)
+		res.push_back(job_info{ j->description.name, j->state, j->description.priority, j->threads, stats(*j), running_ms(*j),
+		                        j->gen ? j->gen->noise_estimate() : 0., j->reached });
+	return res;
+}
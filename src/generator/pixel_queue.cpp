@@ -0,0 +1,31 @@
+#include "generator/pixel_queue.h"
+
+pixel_queue::pixel_queue(size_t blocks_in) :
+	blocks(new block[blocks_in]),
+	capacity(blocks_in)
+{}
+
+pixel_queue::block* pixel_queue::writable() {
+	size_t t { tail.load(std::memory_order_relaxed) };
+	// acquire: the consumer is done with the released block before it is refilled
+	if (t - head.load(std::memory_order_acquire) == capacity)
+		return nullptr;
+	return &blocks[t % capacity];
+}
+
+void pixel_queue::publish() {
+	tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+pixel_queue::block* pixel_queue::readable() {
+	size_t h { head.load(std::memory_order_relaxed) };
+	if (h == tail.load(std::memory_order_acquire))
+		return nullptr;
+	return &blocks[h % capacity];
+}
+
+void pixel_queue::release() {
+	size_t h { head.load(std::memory_order_relaxed) };
+	blocks[h % capacity].size = 0;
+	head.store(h + 1, std::memory_order_release);
+}
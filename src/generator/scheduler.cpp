@@ -0,0 +1,127 @@
+#include "generator/scheduler.h"
+
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+scheduler::scheduler(size_t workers_in) :
+	workers(0),
+	first_index(0),
+	next_index(0),
+	budget(std::numeric_limits<Int>::max()),
+	has_given_back(false)
+{
+	resize(workers_in);
+}
+
+void scheduler::set_budget(Int budget_in) {
+	budget = budget_in ? first_index + budget_in : std::numeric_limits<Int>::max();
+}
+
+void scheduler::set_first_index(Int first) {
+	next_index = first_index = first;
+}
+
+void scheduler::resize(size_t workers_in) {
+	// keep the work left in the queues which are going to be destroyed
+	for (size_t i { 0 } ; i < workers ; i++)
+		give_back(i);
+
+	workers = workers_in;
+	queues = std::make_unique<queue[]>(workers);
+}
+
+Int scheduler::refill(size_t worker, Int size) {
+	size = std::max<Int>(size, 1);
+
+	seed_range r { take_given_back(size) };
+	if (r.empty())
+		r = take_from_budget(size);
+	if (r.empty())
+		r = steal(worker);
+	if (r.empty())
+		return 0;
+
+	std::lock_guard<std::mutex> lock(queues[worker].mutex);
+	queues[worker].r = r;
+	return r.size();
+}
+
+seed_range scheduler::take(size_t worker, Int count) {
+	queue& q { queues[worker] };
+	std::lock_guard<std::mutex> lock(q.mutex);
+	seed_range r { q.r.begin, std::min(q.r.end, q.r.begin + count) };
+	q.r.begin = r.end;
+	return r;
+}
+
+void scheduler::give_back(size_t worker, seed_range taken) {
+	seed_range r;
+	{
+		std::lock_guard<std::mutex> lock(queues[worker].mutex);
+		std::swap(r, queues[worker].r);
+	}
+
+	std::lock_guard<std::mutex> lock(given_back_mutex);
+	for (const seed_range& e : { taken, r })
+		if (!e.empty())
+			given_back.push_back(e);
+	has_given_back = !given_back.empty();
+}
+
+Int scheduler::distributed() const {
+	return std::min(next_index.load(), budget.load()) - first_index;
+}
+
+Int scheduler::close_budget() {
+	// the workers taking indices meanwhile fail their exchange on next_index, then see the new budget
+	Int end { next_index.exchange(std::numeric_limits<Int>::max()) };
+	budget = std::min(budget.load(), end);
+	next_index = end;
+	return distributed();
+}
+
+seed_range scheduler::take_from_budget(Int size) {
+	Int begin { next_index.load() };
+	Int end;
+	do {
+		Int limit { budget.load() };
+		if (begin >= limit)
+			return seed_range();
+		end = limit - begin < size ? limit : begin + size;
+	} while (!next_index.compare_exchange_weak(begin, end));
+	return seed_range{ begin, end };
+}
+
+seed_range scheduler::take_given_back(Int size) {
+	if (!has_given_back)
+		return seed_range();
+
+	std::lock_guard<std::mutex> lock(given_back_mutex);
+	if (given_back.empty())
+		return seed_range();
+
+	seed_range& back { given_back.back() };
+	seed_range r { back.begin, std::min(back.end, back.begin + size) };
+	back.begin = r.end;
+	if (back.empty())
+		given_back.pop_back();
+	has_given_back = !given_back.empty();
+	return r;
+}
+
+seed_range scheduler::steal(size_t thief) {
+	for (size_t offset { 1 } ; offset < workers ; offset++) {
+		queue& victim { queues[(thief + offset) % workers] };
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (victim.r.empty())
+			continue;
+
+		// take the upper half, rounded up so that a single remaining index can be stolen too
+		Int middle { victim.r.begin + victim.r.size() / 2 };
+		seed_range r { middle, victim.r.end };
+		victim.r.end = middle;
+		return r;
+	}
+	return seed_range();
+}
@@ -0,0 +1,73 @@
+#include "generator/seed_block.h"
+
+#include <algorithm>
+#include <utility>
+
+#include "mandelbrot_helper.h"
+
+void seed_block::fill(sampler& seed_sampler, seed_range r) {
+	first_index = r.begin;
+	size = std::min<size_t>(r.size(), capacity);
+	cursor = 0;
+	position = 0;
+	re.resize(size);
+	im.resize(size);
+	inside.resize(size);
+	learns = seed_sampler.learns();
+	samples.clear();
+	if (learns)
+		for (size_t k { 0 } ; k < size ; k++) {
+			samples.push_back(seed_sampler.sample(first_index + k));
+			re[k] = samples[k].sample.real();
+			im[k] = samples[k].sample.imag();
+		}
+	else {
+		weights.resize(size);
+		for (size_t k { 0 } ; k < size ; k++) {
+			std::complex<Real> seed { seed_sampler.draw(first_index + k, weights[k]) };
+			re[k] = seed.real();
+			im[k] = seed.imag();
+		}
+	}
+
+	insideBulbs(re.data(), im.data(), inside.data(), size);
+
+	survivors.clear();
+	for (size_t k { 0 } ; k < size ; k++)
+		if (inside[k] == 0.)
+			survivors.push_back(k);
+}
+
+bool seed_block::next(Int total, Int& index, sample_result& sample, Int& skipped) {
+	size_t end { cursor < survivors.size() ? survivors[cursor] : size };
+	skipped = end - position;
+	if (learns)
+		for ( ; position < end ; position++)
+			samples[position].feedback_result(0, total);
+	position = end;
+	if (cursor == survivors.size())
+		return false;
+
+	index = first_index + position;
+	if (learns) {
+		sample = std::move(samples[position]);
+		plain_handle = false;
+	}
+	else {
+		// the handle of the previous survivor is reused rather than built again
+		sample.sample = std::complex(re[position], im[position]);
+		sample.data_ptr = nullptr;
+		sample.weight = weights[position];
+		if (!plain_handle || !sample.feedback) {
+			sample.feedback = [](std::shared_ptr<void>, Int, Int){ return; };
+			plain_handle = true;
+		}
+	}
+	cursor++;
+	position++;
+	return true;
+}
+
+seed_range seed_block::remaining() const {
+	return { first_index + static_cast<Int>(position), first_index + static_cast<Int>(size) };
+}
@@ -0,0 +1,196 @@
+#include "generator/seed_cache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+
+namespace {
+	constexpr char magic[8] { 'B', 'B', 'S', 'E', 'E', 'D', 'S', '\0' };
+	constexpr uint32_t version { 2 };
+	constexpr size_t seed_bytes { 2 * sizeof(Real) + sizeof(uint32_t) };
+
+	template<typename T>
+	void write_value(std::ostream& stream, const T& value) {
+		stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template<typename T>
+	void read_value(std::istream& stream, T& value) {
+		stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+	}
+
+	// The same field list is used to write and to read a header, so both can never diverge
+	template<typename stream_t, typename header_t, typename fn_t>
+	void for_each_field(stream_t& stream, header_t& h, fn_t fn) {
+		Real a_real { h.properties.seed_corner_a.real() }, a_imag { h.properties.seed_corner_a.imag() };
+		Real b_real { h.properties.seed_corner_b.real() }, b_imag { h.properties.seed_corner_b.imag() };
+		fn(stream, a_real);
+		fn(stream, a_imag);
+		fn(stream, b_real);
+		fn(stream, b_imag);
+		if constexpr (!std::is_const_v<header_t>) {
+			h.properties.seed_corner_a = std::complex<Real>(a_real, a_imag);
+			h.properties.seed_corner_b = std::complex<Real>(b_real, b_imag);
+		}
+		fn(stream, h.properties.sampler_t);
+		fn(stream, h.properties.rng_stream);
+
+		fn(stream, h.parameters.iterations_to_escape);
+		fn(stream, h.parameters.minimum_iterations);
+		fn(stream, h.parameters.escape_norm);
+		fn(stream, h.parameters.y_symetry);
+	}
+}
+
+bool seed_cache_header::replayable_with(const generator_parameters& other, std::string& reason) const {
+	if (other.escape_norm != parameters.escape_norm)
+		reason = "escape norms differ";
+	else if (other.y_symetry != parameters.y_symetry)
+		reason = parameters.y_symetry ? "seeds were recorded in the upper half of a symmetric render" : "seeds were recorded without y symetry";
+	else if (other.iterations_to_escape > parameters.iterations_to_escape)
+		reason = "seeds were recorded with at most " + std::to_string(parameters.iterations_to_escape) + " iterations to escape";
+	else if (other.minimum_iterations < parameters.minimum_iterations)
+		reason = "seeds were recorded with at least " + std::to_string(parameters.minimum_iterations) + " minimum iterations";
+	else
+		return true;
+	return false;
+}
+
+bool seed_cache_writer::open(const std::string& path, const seed_cache_header& header) {
+	file.open(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+
+	file.write(magic, sizeof(magic));
+	write_value(file, version);
+	for_each_field(file, header, [](std::ostream& s, const auto& v){ write_value(s, v); });
+	return static_cast<bool>(file.flush());
+}
+
+bool seed_cache_writer::append(const std::vector<cached_seed>& seeds) {
+	std::vector<char> buffer(seeds.size() * seed_bytes);
+	char* p { buffer.data() };
+	for (auto& seed : seeds) {
+		Real real { seed.z0.real() }, imag { seed.z0.imag() };
+		std::memcpy(p, &real, sizeof(Real));
+		std::memcpy(p + sizeof(Real), &imag, sizeof(Real));
+		std::memcpy(p + 2 * sizeof(Real), &seed.iterations, sizeof(uint32_t));
+		p += seed_bytes;
+	}
+
+	std::lock_guard<std::mutex> lock(mutex);
+	file.write(buffer.data(), buffer.size());
+	m_written += seeds.size();
+	return static_cast<bool>(file);
+}
+
+bool seed_cache_reader::open(const std::string& path) {
+	file.open(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	char file_magic[sizeof(magic)];
+	uint32_t file_version;
+	file.read(file_magic, sizeof(file_magic));
+	read_value(file, file_version);
+	if (!file || std::memcmp(file_magic, magic, sizeof(magic)) != 0 || file_version != version)
+		return false;
+
+	for_each_field(file, m_header, [](std::istream& s, auto& v){ read_value(s, v); });
+	return static_cast<bool>(file);
+}
+
+bool seed_cache_reader::read(std::vector<cached_seed>& seeds, size_t count) {
+	std::vector<char> buffer(count * seed_bytes);
+	file.read(buffer.data(), buffer.size());
+	size_t read { static_cast<size_t>(file.gcount()) / seed_bytes };
+
+	seeds.resize(read);
+	const char* p { buffer.data() };
+	for (auto& seed : seeds) {
+		Real real, imag;
+		std::memcpy(&real, p, sizeof(Real));
+		std::memcpy(&imag, p + sizeof(Real), sizeof(Real));
+		std::memcpy(&seed.iterations, p + 2 * sizeof(Real), sizeof(uint32_t));
+		seed.z0 = std::complex<Real>(real, imag);
+		p += seed_bytes;
+	}
+	return read != 0;
+}
+
+generator_stats replay_seeds(seed_cache_reader& reader, const generator_properties& properties, const generator_parameters& parameters,
+                             abstractImage& img, uint32_t threads_number) {
+	constexpr size_t chunk_seeds { 1 << 14 };
+	constexpr size_t chunk_pixels { 1 << 14 };
+	std::mutex reader_mutex, image_mutex, stats_mutex;
+	generator_stats stats;
+
+	auto replay = [&]{
+		std::vector<cached_seed> seeds;
+		std::vector<std::pair<uint16_t, uint16_t>> pixels;
+		generator_stats local;
+		Real real_m = properties.corner_a.real();
+		Real real_M = properties.corner_b.real();
+		Real imag_m = properties.corner_a.imag();
+		Real imag_M = properties.corner_b.imag();
+		auto flush_pixels = [&]{
+			local.points_in_view += pixels.size();
+			std::lock_guard<std::mutex> lock(image_mutex);
+			for (auto [x, y] : pixels)
+				img.incr(x, y);
+			pixels.clear();
+		};
+		// pixels are scattered by bounded chunks, whatever the length of the orbits
+		auto plot = [&](Real re, Real im) {
+			if (re < real_m || real_M <= re || im < imag_m || imag_M <= im)
+				return;
+			uint16_t x = (re - real_m) / (real_M - real_m) * static_cast<Real>(properties.image_width);
+			uint16_t y = (im - imag_m) / (imag_M - imag_m) * static_cast<Real>(properties.image_height);
+			pixels.emplace_back(x, y);
+			if (pixels.size() == chunk_pixels)
+				flush_pixels();
+		};
+
+		for (;;) {
+			{
+				std::lock_guard<std::mutex> lock(reader_mutex);
+				if (!reader.read(seeds, chunk_seeds))
+					break;
+			}
+
+			// the iteration count was recorded, so only the accepted orbits are traced again
+			pixels.clear();
+			for (auto& seed : seeds) {
+				local.seeds++;
+				if (seed.iterations >= parameters.iterations_to_escape || seed.iterations < parameters.minimum_iterations) {
+					local.below_minimum_rejects += seed.iterations < parameters.minimum_iterations;
+					local.non_escaping_rejects += seed.iterations >= parameters.iterations_to_escape;
+					continue;
+				}
+
+				Int first_point { local.points_in_view + static_cast<Int>(pixels.size()) };
+				std::complex<Real> z { seed.z0 };
+				for (uint32_t k { 0 } ; k < seed.iterations ; k++, z = z * z + seed.z0) {
+					plot(z.real(), z.imag());
+					if (parameters.y_symetry)
+						plot(z.real(), -z.imag());
+				}
+				local.accepted_orbits++;
+				local.orbit_points += seed.iterations;
+				local.missed_view_orbits += local.points_in_view + static_cast<Int>(pixels.size()) == first_point;
+			}
+			flush_pixels();
+		}
+
+		std::lock_guard<std::mutex> lock(stats_mutex);
+		stats += local;
+	};
+
+	std::vector<std::thread> threads;
+	for (uint32_t i { 0 } ; i < std::max(1u, threads_number) ; i++)
+		threads.emplace_back(replay);
+	for (auto& thread : threads)
+		thread.join();
+	return stats;
+}
@@ -0,0 +1,76 @@
+#include "generator/thread_pool.h"
+
+#include <algorithm>
+
+thread_pool& thread_pool::shared() {
+	static thread_pool pool;
+	return pool;
+}
+
+thread_pool::thread_pool() :
+	max_threads(std::max(1u, std::thread::hardware_concurrency()))
+{}
+
+thread_pool::~thread_pool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		exiting = true;
+	}
+	wake.notify_all();
+	for (auto& thread : threads)
+		thread.join();
+}
+
+void thread_pool::submit(std::function<void()> job) {
+	std::lock_guard<std::mutex> lock(mutex);
+	jobs.push_back(std::move(job));
+	wake.notify_one();
+	start_threads();
+}
+
+void thread_pool::set_capacity(size_t capacity) {
+	std::lock_guard<std::mutex> lock(mutex);
+	max_threads = std::max<size_t>(1, capacity);
+	start_threads();
+}
+
+size_t thread_pool::capacity() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return max_threads;
+}
+
+void thread_pool::start_threads() {
+	size_t waiting { jobs.size() > idle_threads ? jobs.size() - idle_threads : 0 };
+	size_t missing { std::min(waiting, max_threads > threads.size() ? max_threads - threads.size() : 0) };
+	for (size_t t { 0 } ; t < missing ; t++) {
+		// idle from its creation, so that the next jobs do not create a thread for the job it will take
+		idle_threads++;
+		threads.emplace_back([this]{ run(); });
+	}
+}
+
+size_t thread_pool::size() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return threads.size();
+}
+
+size_t thread_pool::idle() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return idle_threads;
+}
+
+void thread_pool::run() {
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;) {
+		wake.wait(lock, [this]{ return exiting || !jobs.empty(); });
+		if (jobs.empty())
+			return;
+		idle_threads--;
+		std::function<void()> job { std::move(jobs.front()) };
+		jobs.pop_front();
+		lock.unlock();
+		job();
+		lock.lock();
+		idle_threads++;
+	}
+}
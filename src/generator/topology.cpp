@@ -0,0 +1,119 @@
+#include "generator/topology.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+size_t numa_topology::node_of_cpu(uint32_t cpu) const {
+	for (size_t node { 0 } ; node < nodes_cpus.size() ; node++)
+		for (uint32_t c : nodes_cpus[node])
+			if (c == cpu)
+				return node;
+	return 0;
+}
+
+std::vector<uint32_t> parse_cpu_list(const std::string& list) {
+	std::vector<uint32_t> cpus;
+	std::stringstream stream(list);
+	std::string item;
+	while (std::getline(stream, item, ',')) {
+		if (item.empty() || item == "\n")
+			continue;
+		size_t dash { item.find('-') };
+		uint32_t first = std::stoul(item.substr(0, dash));
+		uint32_t last = dash == std::string::npos ? first : std::stoul(item.substr(dash + 1));
+		for (uint32_t cpu { first } ; cpu <= last ; cpu++)
+			cpus.push_back(cpu);
+	}
+	return cpus;
+}
+
+numa_topology detect_topology() {
+	numa_topology topology;
+
+#ifdef __linux__
+	for (size_t node { 0 } ; ; node++) {
+		std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+		if (!file)
+			break;
+		std::string list;
+		std::getline(file, list);
+		std::vector<uint32_t> cpus { parse_cpu_list(list) };
+		if (!cpus.empty()) // memory-only nodes have no CPU
+			topology.nodes_cpus.push_back(cpus);
+	}
+#endif
+
+	if (topology.nodes_cpus.empty()) {
+		std::vector<uint32_t> cpus;
+		for (uint32_t cpu { 0 } ; cpu < std::max(1u, std::thread::hardware_concurrency()) ; cpu++)
+			cpus.push_back(cpu);
+		topology.nodes_cpus.push_back(cpus);
+	}
+	return topology;
+}
+
+std::vector<uint32_t> assign_cpus(const numa_topology& topology, thread_affinity affinity, const std::vector<uint32_t>& cores, uint32_t threads_number) {
+	std::vector<uint32_t> res;
+	switch (affinity) {
+	case thread_affinity::None:
+		break;
+	case thread_affinity::Compact: // fill each node before using the next one
+	{
+		std::vector<uint32_t> all;
+		for (auto& cpus : topology.nodes_cpus)
+			all.insert(all.end(), cpus.begin(), cpus.end());
+		for (uint32_t i { 0 } ; i < threads_number ; i++)
+			res.push_back(all[i % all.size()]);
+		break;
+	}
+	case thread_affinity::Scatter: // round-robin over the nodes
+	{
+		size_t nodes { topology.nodes_cpus.size() };
+		for (uint32_t i { 0 } ; i < threads_number ; i++) {
+			auto& cpus { topology.nodes_cpus[i % nodes] };
+			res.push_back(cpus[(i / nodes) % cpus.size()]);
+		}
+		break;
+	}
+	case thread_affinity::CoreList:
+		if (cores.empty())
+			break;
+		for (uint32_t i { 0 } ; i < threads_number ; i++)
+			res.push_back(cores[i % cores.size()]);
+		break;
+	}
+	return res;
+}
+
+bool pin_current_thread(uint32_t cpu) {
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	(void)cpu;
+	return false;
+#endif
+}
+
+bool unpin_current_thread(const numa_topology& topology) {
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (auto& cpus : topology.nodes_cpus)
+		for (uint32_t cpu : cpus)
+			CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	(void)topology;
+	return false;
+#endif
+}
@@ -1,6 +1,10 @@
 #include "gui/generator_panel.h"
 
+#include <cinttypes>
+#include <string>
+
 #include "generator/generator_info.h"
+#include "generator/topology.h"
 #include "image/image.h"
 
 #include "glad/glad.h"
@@ -126,32 +130,42 @@ void generator_panel::display_panel() {
 		ImGui::InputScalar("Image width", ImGuiDataType_U16, &properties.image_width);
 		ImGui::InputScalar("Image height", ImGuiDataType_U16, &properties.image_height);
 
-		double a_real { properties.corner_a.real() }
-		     , a_imag { properties.corner_a.imag() }
-		     , b_real { properties.corner_b.real() }
-		     , b_imag { properties.corner_b.imag() };
-		ImGui::InputScalar("Corner A (real)", ImGuiDataType_Double, &a_real);
-		ImGui::InputScalar("Corner A (imag)", ImGuiDataType_Double, &a_imag);
-		ImGui::InputScalar("Corner B (real)", ImGuiDataType_Double, &b_real);
-		ImGui::InputScalar("Corner B (imag)", ImGuiDataType_Double, &b_imag);
-		// ensure that the real parts are different (same for imaginary parts), and add one if not
-		if (a_real == b_real) b_real += 1;
-		if (a_imag == b_imag) b_imag += 1;
-		// ensure that corner_a is the bottom left corner, and corner_b is the top one
-		properties.corner_a.real(std::min(a_real, b_real));
-		properties.corner_a.imag(std::min(a_imag, b_imag));
-		properties.corner_b.real(std::max(a_real, b_real));
-		properties.corner_b.imag(std::max(a_imag, b_imag));
-
-		static bool use_monte_carlo_sampler = properties.sampler_t == sampler_type::MonteCarlo;
-		ImGui::Checkbox("Use Monte Carlo sampler", &use_monte_carlo_sampler);
-		if (use_monte_carlo_sampler) {
-			properties.sampler_t = sampler_type::MonteCarlo;
+		auto input_corners = [](const std::string& prefix, std::complex<Real>& corner_a, std::complex<Real>& corner_b) {
+			double a_real { corner_a.real() }
+			     , a_imag { corner_a.imag() }
+			     , b_real { corner_b.real() }
+			     , b_imag { corner_b.imag() };
+			ImGui::InputScalar((prefix + "Corner A (real)").c_str(), ImGuiDataType_Double, &a_real);
+			ImGui::InputScalar((prefix + "Corner A (imag)").c_str(), ImGuiDataType_Double, &a_imag);
+			ImGui::InputScalar((prefix + "Corner B (real)").c_str(), ImGuiDataType_Double, &b_real);
+			ImGui::InputScalar((prefix + "Corner B (imag)").c_str(), ImGuiDataType_Double, &b_imag);
+			// ensure that the real parts are different (same for imaginary parts), and add one if not
+			if (a_real == b_real) b_real += 1;
+			if (a_imag == b_imag) b_imag += 1;
+			// ensure that corner_a is the bottom left corner, and corner_b is the top one
+			corner_a.real(std::min(a_real, b_real));
+			corner_a.imag(std::min(a_imag, b_imag));
+			corner_b.real(std::max(a_real, b_real));
+			corner_b.imag(std::max(a_imag, b_imag));
+		};
+		input_corners("", properties.corner_a, properties.corner_b);
+		// seeds of the orbits crossing a zoomed view lie far outside of it
+		input_corners("Seed domain ", properties.seed_corner_a, properties.seed_corner_b);
+
+		int sampler { static_cast<int>(properties.sampler_t) };
+		const char* samplers[] { "Uniform", "Monte Carlo", "Sobol", "Halton", "R2", "Metropolis-Hastings", "Importance map" };
+		ImGui::Combo("Sampler", &sampler, samplers, 7);
+		properties.sampler_t = static_cast<sampler_type>(sampler);
+		if (properties.sampler_t == sampler_type::MonteCarlo) {
 			ImGui::InputScalar("Number of layers", ImGuiDataType_U64, &properties.layers);
 			ImGui::InputScalar("Layers' resolution", ImGuiDataType_U64, &properties.layer_resolution);
+			ImGui::InputScalar("Maximum tree nodes", ImGuiDataType_U64, &properties.tree_max_nodes);
+			ImGui::Checkbox("Tree shared by the threads", &properties.shared_tree);
+			ImGui::InputDouble("Cached tree decay", &properties.tree_decay);
 		}
-		else {
-			properties.sampler_t = sampler_type::Uniform;
+		if (properties.sampler_t == sampler_type::ImportanceMap) {
+			ImGui::InputScalar("Pilot resolution", ImGuiDataType_U64, &properties.pilot_resolution);
+			ImGui::InputScalar("Pilot seeds per cell", ImGuiDataType_U64, &properties.pilot_seeds);
 		}
 
 		if ((gen_ptr->get_status() == status::Stopped)
@@ -177,18 +191,34 @@ void generator_panel::display_panel() {
 	}
 	if (ImGui::CollapsingHeader("Runtime parameters")) {
 		ImGui::InputScalar("Threads in pool", ImGuiDataType_U16, &runtime_parameters.threads_number);
+		ImGui::InputScalar("Scatter threads", ImGuiDataType_U32, &runtime_parameters.scatter_threads);
 		ImGui::InputScalar("Total of points", ImGuiDataType_U64, &runtime_parameters.points_target);
 		ImGui::InputScalar("Points in pool", ImGuiDataType_U64, &runtime_parameters.pool_batch_size);
 		ImGui::InputScalar("Points in batch", ImGuiDataType_U64, &runtime_parameters.thread_batch_size);
+		ImGui::InputScalar("Batch duration (ms)", ImGuiDataType_U64, &runtime_parameters.batch_duration_ms);
+		ImGui::InputScalar("Time budget (ms)", ImGuiDataType_U64, &runtime_parameters.time_budget_ms);
+		ImGui::InputScalar("Accepted orbits target", ImGuiDataType_U64, &runtime_parameters.accepted_orbits_target);
+		ImGui::InputDouble("Noise target", &runtime_parameters.noise_target);
+
+		int affinity { static_cast<int>(runtime_parameters.affinity) };
+		const char* affinities[] { "None", "Compact", "Scatter", "Core list" };
+		ImGui::Combo("Thread affinity", &affinity, affinities, 4);
+		runtime_parameters.affinity = static_cast<thread_affinity>(affinity);
+		if (runtime_parameters.affinity == thread_affinity::CoreList) {
+			ImGui::InputText("Cores (e.g. 0-7,16)", affinity_cores, sizeof(affinity_cores));
+			runtime_parameters.affinity_cores = parse_cpu_list(affinity_cores);
+		}
 
-		if ((gen_ptr->get_status() == status::Stopped)
-		&& ImGui::Button("Set runtime parameters")) {
+		// applied live, the workers are added or retired without stopping the render
+		if (ImGui::Button("Set runtime parameters")) {
 			gen_ptr->set_runtime_parameters(runtime_parameters);
 		}
 	}
 	if (ImGui::CollapsingHeader("Runtime control")) {
 		std::string_view status_string { status_to_string(gen_ptr->get_status()) };
 		ImGui::Text("Generator's status : %s", status_string.data());
+		std::string_view target_string { target_to_string(gen_ptr->reached_target()) };
+		ImGui::Text("Reached target : %s, estimated noise %.4f", target_string.data(), gen_ptr->noise_estimate());
 
 		if (ImGui::Button("Resume"))       { gen_ptr->resume(); }
 		if (ImGui::Button("Pause"))        { gen_ptr->pause(); }
@@ -219,15 +249,61 @@ void generator_panel::display_panel() {
 			ImGui::Text("Total : %lu", total_progress);
 		}
 	}
+	if (ImGui::CollapsingHeader("Performance")) {
+		display_performance();
+	}
 
 	ImGui::End();
 }
 
+void generator_panel::display_performance() {
+	generator_stats stats { gen_ptr->stats() };
+
+	auto now { std::chrono::steady_clock::now() };
+	std::chrono::duration<double> elapsed { now - last_stats_time };
+	if (elapsed.count() >= 1.) {
+		stats_per_second = stats;
+		stats_per_second -= last_stats;
+		// rates are stored as counts per second, rounded
+		stats_per_second.seeds /= elapsed.count();
+		stats_per_second.accepted_orbits /= elapsed.count();
+		stats_per_second.orbit_points /= elapsed.count();
+		stats_per_second.points_in_view /= elapsed.count();
+		last_stats = stats;
+		last_stats_time = now;
+
+		std::vector<generator_stats> node_stats { gen_ptr->node_stats() };
+		node_stats_per_second = node_stats;
+		last_node_stats.resize(node_stats.size());
+		for (size_t node { 0 } ; node < node_stats.size() ; node++) {
+			node_stats_per_second[node] -= last_node_stats[node];
+			node_stats_per_second[node].seeds /= elapsed.count();
+			node_stats_per_second[node].orbit_points /= elapsed.count();
+		}
+		last_node_stats = node_stats;
+	}
+
+	auto ratio = [&](Int value) { return stats.seeds ? 100.f * value / stats.seeds : 0.f; };
+
+	ImGui::Text("Seeds drawn : %" PRIu64 " (%" PRIu64 "/s)", stats.seeds, stats_per_second.seeds);
+	ImGui::Text("Rejected inside cardioids : %" PRIu64 " (%.1f%%)", stats.cardioid_rejects, ratio(stats.cardioid_rejects));
+	ImGui::Text("Rejected non-escaping : %" PRIu64 " (%.1f%%)", stats.non_escaping_rejects, ratio(stats.non_escaping_rejects));
+	ImGui::Text("Rejected below minimum : %" PRIu64 " (%.1f%%)", stats.below_minimum_rejects, ratio(stats.below_minimum_rejects));
+	ImGui::Text("Accepted orbits : %" PRIu64 " (%.3f%%, %" PRIu64 "/s)", stats.accepted_orbits, ratio(stats.accepted_orbits), stats_per_second.accepted_orbits);
+	ImGui::Text("Orbit points scattered : %" PRIu64 " (%" PRIu64 "/s)", stats.orbit_points, stats_per_second.orbit_points);
+	ImGui::Text("Points in view : %" PRIu64 " (%" PRIu64 "/s)", stats.points_in_view, stats_per_second.points_in_view);
+	ImGui::Text("Time in lock waits : %.3f s", stats.lock_wait_ns * 1e-9);
+	for (size_t node { 0 } ; node < node_stats_per_second.size() ; node++) {
+		ImGui::Text("NUMA node %zu : %" PRIu64 " seeds/s, %" PRIu64 " orbit points/s", node, node_stats_per_second[node].seeds, node_stats_per_second[node].orbit_points);
+	}
+}
+
 void generator_panel::display_image(int display_width, int display_height) {
 	glUseProgram(shader_program);
 
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, texture);
+	gen_ptr->merge_replicas();
 	std::vector<pixel> image = image_ptr->get_image();
 	uint8_t* pixels_ptr = reinterpret_cast<uint8_t*>(image.data());
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, gen_ptr->properties.image_width, gen_ptr->properties.image_height, 0, GL_RGB, GL_UNSIGNED_BYTE, pixels_ptr);
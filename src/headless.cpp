@@ -0,0 +1,642 @@
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef BUDDHABROT_MULTIPROCESS
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "coordinator/coordinator.h"
+#include "image/shared_image.h"
+#endif
+
+#include "generator/generator.h"
+#include "generator/generator_info.h"
+#include "generator/job_scheduler.h"
+#include "generator/seed_cache.h"
+#include "generator/thread_pool.h"
+#include "generator/topology.h"
+#include "helper.h"
+#include "image/image.h"
+#include "image/shard.h"
+#include "types.h"
+
+std::atomic<bool> interrupted { false };
+std::atomic<int> threads_change { 0 }; // workers to add, or to retire when negative, sent by SIGUSR1 and SIGUSR2
+
+struct headless_options {
+	generator_properties properties;
+	generator_parameters parameters;
+	generator_runtime_parameters runtime_parameters;
+	bool threads_set { false };
+	size_t pool_threads { 0 }; // 0 for the pool's default capacity
+	double log_interval { 10. };
+	std::string output;
+	std::string shard;
+	std::string record_seeds;
+	std::string replay;
+
+	std::string job_directory;
+	std::string submit;
+	Int priority { 0 };
+	Real share { 1. };
+
+	unsigned processes { 0 };
+	std::string checkpoint;
+	double checkpoint_interval { 300. };
+	// set in the worker processes spawned by the coordinator
+	std::string worker_socket;
+	std::string worker_image;
+};
+
+void usage(const char* program) {
+	std::cerr << "Usage: " << program << " [options]\n"
+	          << "  --width W              image width (default 720)\n"
+	          << "  --height H             image height (default 720)\n"
+	          << "  --corners AR AI BR BI  rendered rectangle of the complex plane\n"
+	          << "  --seed-domain AR AI BR BI  rectangle the seeds are drawn from (default: -2 -2 2 2)\n"
+	          << "  --iterations N         iterations to escape\n"
+	          << "  --minimum N            minimum iterations\n"
+	          << "  --y-symetry            mirror the image along the real axis\n"
+	          << "  --threads N            number of worker threads\n"
+	          << "  --scatter-threads N    threads applying the orbits to bands of the image, while the others only iterate (default 0)\n"
+	          << "  --pool-threads N       threads the workers run on, the others waiting for one (default: hardware threads)\n"
+	          << "  --points N             number of seeds to process, 0 to run until interrupted\n"
+	          << "  --time-budget S        stop after S seconds of rendering\n"
+	          << "  --accepted-target N    stop once N orbits were accepted\n"
+	          << "  --noise-target E       stop once the estimated relative noise of the image is below E, such as 0.05, not with --processes\n"
+	          << "  --batch N              seeds in the first batch of each thread\n"
+	          << "  --batch-duration MS    target duration of a batch, 0 for fixed batch sizes (default 250)\n"
+	          << "  --affinity A           none, compact, scatter, or a list of cores such as 0-7,16-23\n"
+	          << "  --log-interval S       seconds between two performance log lines (default 10)\n"
+	          << "  --stream N             RNG stream of the samplers, distinct for each shard of a render (default: random)\n"
+	          << "  --sampler S            uniform, monte-carlo (default), sobol, halton, r2, metropolis or importance\n"
+	          << "  --layers N             monte-carlo: maximum depth of the tree (default 2)\n"
+	          << "  --layer-resolution N   monte-carlo: cells are split into N x N sub-cells (default 8)\n"
+	          << "  --tree-nodes N         monte-carlo: maximum number of nodes of each tree (default 1048576)\n"
+	          << "  --tree-per-thread      monte-carlo: each thread learns its own tree instead of sharing one\n"
+	          << "  --tree-decay F         monte-carlo: share of the counters of the cached tree kept when starting (default 0.8)\n"
+	          << "  --pilot-resolution N   importance: the pilot pass estimates the importance of N x N cells (default 128)\n"
+	          << "  --pilot-seeds N        importance: seeds traced per cell by the pilot pass (default 4)\n"
+	          << "  --cache-dir DIR        load the importance pilot pass and the shared Monte Carlo tree from DIR, and save them there\n"
+	          << "  --deterministic        seeds only depend on the stream and their index, the image does not depend on --threads\n"
+	          << "  --first-seed N         with --deterministic, index of the first seed, to continue a render of N seeds\n"
+	          << "  --output FILE          write the image as a binary PGM file\n"
+	          << "  --shard FILE           write the histogram as a shard, to be merged with buddhabrot-merge\n"
+	          << "  --record-seeds FILE    append the accepted seeds to a cache, to be replayed with other parameters\n"
+	          << "  --replay FILE          render the seeds of a cache instead of drawing new ones\n"
+	          << "  --processes P          render with P local worker processes sharing the histogram in shared memory\n"
+	          << "  --checkpoint FILE      with --processes, periodically write the histogram as a shard\n"
+	          << "  --checkpoint-interval S  seconds between two checkpoints, or two saves of the jobs (default 300)\n"
+	          << "  --jobs DIR             run the queue of render jobs saved in DIR until they are all finished, sharing the threads\n"
+	          << "  --submit NAME          with --jobs, add a job rendering the above options to the queue, and exit\n"
+	          << "  --priority P           with --submit, jobs of a higher priority preempt the others until they finish (default 0)\n"
+	          << "  --share S              with --submit, weight of the job among the jobs of the same priority (default 1)\n"
+	          << "While rendering, SIGUSR1 adds a thread and SIGUSR2 retires one, without restarting the render.\n";
+}
+
+bool write_pgm(const std::string& path, abstractImage& img) {
+	std::ofstream file(path, std::ios::binary);
+	if (!file)
+		return false;
+	file << "P5\n" << img.width() << " " << img.height() << "\n255\n";
+	for (auto& p : img.get_image())
+		file.put(static_cast<char>(p.r));
+	return static_cast<bool>(file);
+}
+
+void log_delta(const std::string& prefix, const generator_stats& stats, generator_stats& last_stats, double seconds) {
+	generator_stats delta { stats };
+	delta -= last_stats;
+	std::clog << prefix << stats_to_string(delta, seconds) << std::endl;
+	last_stats = stats;
+}
+
+bool write_outputs(const headless_options& options, const shard_header& header, abstractImage& img) {
+	if (!options.output.empty() && !write_pgm(options.output, img)) {
+		std::cerr << "Cannot write " << options.output << "\n";
+		return false;
+	}
+	if (!options.shard.empty() && !write_shard(options.shard, header, img)) {
+		std::cerr << "Cannot write " << options.shard << "\n";
+		return false;
+	}
+	return true;
+}
+
+bool parse_options(int argc, char** argv, headless_options& options) {
+	generator_properties& properties { options.properties };
+	generator_parameters& parameters { options.parameters };
+	generator_runtime_parameters& runtime_parameters { options.runtime_parameters };
+	runtime_parameters.threads_number = std::max(1u, std::thread::hardware_concurrency());
+	runtime_parameters.pool_batch_size = 0;
+
+	for (int i { 1 } ; i < argc ; i++) {
+		std::string arg { argv[i] };
+		auto next = [&]() -> const char* {
+			if (i + 1 >= argc) {
+				usage(argv[0]);
+				std::exit(1);
+			}
+			return argv[++i];
+		};
+
+		if      (arg == "--width")        properties.image_width = std::atoi(next());
+		else if (arg == "--height")       properties.image_height = std::atoi(next());
+		else if (arg == "--corners") {
+			Real ar { std::atof(next()) }, ai { std::atof(next()) }, br { std::atof(next()) }, bi { std::atof(next()) };
+			properties.corner_a = std::complex<Real>(std::min(ar, br), std::min(ai, bi));
+			properties.corner_b = std::complex<Real>(std::max(ar, br), std::max(ai, bi));
+		}
+		else if (arg == "--seed-domain") {
+			Real ar { std::atof(next()) }, ai { std::atof(next()) }, br { std::atof(next()) }, bi { std::atof(next()) };
+			properties.seed_corner_a = std::complex<Real>(std::min(ar, br), std::min(ai, bi));
+			properties.seed_corner_b = std::complex<Real>(std::max(ar, br), std::max(ai, bi));
+		}
+		else if (arg == "--iterations")   parameters.iterations_to_escape = std::strtoull(next(), nullptr, 10);
+		else if (arg == "--minimum")      parameters.minimum_iterations = std::strtoull(next(), nullptr, 10);
+		else if (arg == "--y-symetry")    parameters.y_symetry = true;
+		else if (arg == "--threads") {
+			runtime_parameters.threads_number = std::max(1, std::atoi(next()));
+			options.threads_set = true;
+		}
+		else if (arg == "--scatter-threads") runtime_parameters.scatter_threads = std::atoi(next());
+		else if (arg == "--pool-threads") options.pool_threads = std::max(1, std::atoi(next()));
+		else if (arg == "--points")       runtime_parameters.points_target = std::strtoull(next(), nullptr, 10);
+		else if (arg == "--time-budget")  runtime_parameters.time_budget_ms = static_cast<Int>(std::atof(next()) * 1000.);
+		else if (arg == "--accepted-target") runtime_parameters.accepted_orbits_target = std::strtoull(next(), nullptr, 10);
+		else if (arg == "--noise-target") runtime_parameters.noise_target = std::atof(next());
+		else if (arg == "--batch")        runtime_parameters.thread_batch_size = std::strtoull(next(), nullptr, 10);
+		else if (arg == "--batch-duration") runtime_parameters.batch_duration_ms = std::strtoull(next(), nullptr, 10);
+		else if (arg == "--affinity") {
+			std::string affinity { next() };
+			if      (affinity == "none")    runtime_parameters.affinity = thread_affinity::None;
+			else if (affinity == "compact") runtime_parameters.affinity = thread_affinity::Compact;
+			else if (affinity == "scatter") runtime_parameters.affinity = thread_affinity::Scatter;
+			else {
+				runtime_parameters.affinity = thread_affinity::CoreList;
+				runtime_parameters.affinity_cores = parse_cpu_list(affinity);
+			}
+		}
+		else if (arg == "--log-interval") options.log_interval = std::atof(next());
+		else if (arg == "--stream")       properties.rng_stream = std::strtoull(next(), nullptr, 10);
+		else if (arg == "--sampler") {
+			std::string sampler { next() };
+			if      (sampler == "uniform")     properties.sampler_t = sampler_type::Uniform;
+			else if (sampler == "monte-carlo") properties.sampler_t = sampler_type::MonteCarlo;
+			else if (sampler == "sobol")       properties.sampler_t = sampler_type::Sobol;
+			else if (sampler == "halton")      properties.sampler_t = sampler_type::Halton;
+			else if (sampler == "r2")          properties.sampler_t = sampler_type::R2;
+			else if (sampler == "metropolis")  properties.sampler_t = sampler_type::MetropolisHastings;
+			else if (sampler == "importance")  properties.sampler_t = sampler_type::ImportanceMap;
+			else {
+				usage(argv[0]);
+				return false;
+			}
+		}
+		else if (arg == "--layers")       properties.layers = std::strtoull(next(), nullptr, 10);
+		else if (arg == "--layer-resolution") properties.layer_resolution = std::strtoull(next(), nullptr, 10);
+		else if (arg == "--tree-nodes")   properties.tree_max_nodes = std::strtoull(next(), nullptr, 10);
+		else if (arg == "--tree-per-thread") properties.shared_tree = false;
+		else if (arg == "--tree-decay")   properties.tree_decay = std::atof(next());
+		else if (arg == "--pilot-resolution") properties.pilot_resolution = std::strtoull(next(), nullptr, 10);
+		else if (arg == "--pilot-seeds")  properties.pilot_seeds = std::strtoull(next(), nullptr, 10);
+		else if (arg == "--cache-dir")    runtime_parameters.cache_directory = next();
+		else if (arg == "--deterministic") properties.deterministic = true;
+		else if (arg == "--first-seed")   properties.first_seed_index = std::strtoull(next(), nullptr, 10);
+		else if (arg == "--output")       options.output = next();
+		else if (arg == "--shard")        options.shard = next();
+		else if (arg == "--record-seeds") options.record_seeds = next();
+		else if (arg == "--replay")       options.replay = next();
+		else if (arg == "--processes")    options.processes = std::max(0, std::atoi(next()));
+		else if (arg == "--checkpoint")   options.checkpoint = next();
+		else if (arg == "--checkpoint-interval") options.checkpoint_interval = std::atof(next());
+		else if (arg == "--jobs")         options.job_directory = next();
+		else if (arg == "--submit")       options.submit = next();
+		else if (arg == "--priority")     options.priority = std::strtoll(next(), nullptr, 10);
+		else if (arg == "--share")        options.share = std::atof(next());
+		else if (arg == "--worker") {
+			options.worker_socket = next();
+			options.worker_image = next();
+		}
+		else {
+			usage(argv[0]);
+			return false;
+		}
+	}
+	// as the generator does, so that the options are checked against the render it makes
+	if (samples_by_index(properties.sampler_t))
+		properties.deterministic = true;
+	return true;
+}
+
+// Reject the options which cannot be combined, whatever the mode the render then runs in
+bool check_options(const headless_options& options) {
+#ifndef BUDDHABROT_MULTIPROCESS
+	if (options.processes > 0) {
+		std::cerr << "Multi-process rendering is not supported on this platform\n";
+		return false;
+	}
+#endif
+	if (options.properties.deterministic && options.properties.sampler_t == sampler_type::MetropolisHastings) {
+		std::cerr << "Metropolis-Hastings renders cannot be deterministic\n";
+		return false;
+	}
+	if (options.processes > 0 && (!options.record_seeds.empty() || !options.replay.empty())) {
+		std::cerr << "Seed caches are recorded and replayed by a single process\n";
+		return false;
+	}
+	if (!options.job_directory.empty() && (options.processes > 0 || !options.record_seeds.empty() || !options.replay.empty())) {
+		std::cerr << "Jobs run in this process, without seed caches\n";
+		return false;
+	}
+	if (options.processes > 0 && options.runtime_parameters.noise_target > 0.) {
+		std::cerr << "The noise target is estimated by a single process\n";
+		return false;
+	}
+	if (options.processes > 0 && options.properties.deterministic) {
+		std::cerr << "Deterministic renders use a single process\n";
+		return false;
+	}
+	return true;
+}
+
+// Scale the render up or down without stopping it
+void apply_threads_change(generator& gen) {
+	int change { threads_change.exchange(0) };
+	if (change == 0)
+		return;
+	generator_runtime_parameters runtime_parameters { gen.runtime_parameters };
+	runtime_parameters.threads_number = std::max(1, static_cast<int>(runtime_parameters.threads_number) + change);
+	gen.set_runtime_parameters(runtime_parameters);
+	std::clog << "Now running " << runtime_parameters.threads_number << " threads" << std::endl;
+}
+
+int run_local(headless_options& options) {
+	using namespace std::chrono_literals;
+
+	auto image_ptr { std::make_shared<image>(options.properties.image_width, options.properties.image_height) };
+	generator gen(image_ptr, options.properties, options.parameters, options.runtime_parameters);
+	auto recorder { std::make_shared<seed_cache_writer>() };
+	if (!options.record_seeds.empty()) {
+		if (!recorder->open(options.record_seeds, seed_cache_header{ gen.properties, gen.parameters })) {
+			std::cerr << "Cannot write " << options.record_seeds << "\n";
+			return 1;
+		}
+		gen.set_seed_recorder(recorder);
+	}
+
+	auto start { std::chrono::steady_clock::now() };
+	auto last_log { start };
+	generator_stats last_stats;
+	std::vector<generator_stats> last_node_stats;
+	auto target_reached = [&]{
+		auto [done, target] = gen.total_progress();
+		// a reached target becomes the points target, once the seeds handed out before it are done
+		return target != 0 && done >= target;
+	};
+
+	gen.resume();
+	while (!interrupted && !target_reached()) {
+		// often enough not to overshoot a time budget much
+		std::this_thread::sleep_for(10ms);
+		apply_threads_change(gen);
+
+		auto now { std::chrono::steady_clock::now() };
+		std::chrono::duration<double> since_log { now - last_log };
+		if (options.log_interval > 0. && since_log.count() >= options.log_interval) {
+			std::chrono::duration<double> elapsed { now - start };
+			log_delta("[" + std::to_string(static_cast<Int>(elapsed.count())) + "s] ", gen.stats(), last_stats, since_log.count());
+
+			std::vector<generator_stats> node_stats { gen.node_stats() };
+			last_node_stats.resize(node_stats.size());
+			for (size_t node { 0 } ; node < node_stats.size() ; node++)
+				log_delta("  node " + std::to_string(node) + ": ", node_stats[node], last_node_stats[node], since_log.count());
+			last_log = now;
+		}
+	}
+	std::chrono::duration<double> elapsed { std::chrono::steady_clock::now() - start };
+	gen.stop();
+
+	std::clog << "[total " << elapsed.count() << "s] " << stats_to_string(gen.stats(), elapsed.count()) << std::endl;
+	if (gen.reached_target() != render_target::None)
+		std::clog << "Target reached: " << target_to_string(gen.reached_target()) << std::endl;
+	if (options.runtime_parameters.noise_target > 0.)
+		std::clog << "Estimated noise: " << gen.noise_estimate() << std::endl;
+	if (!options.record_seeds.empty())
+		std::clog << recorder->written() << " seeds recorded in " << options.record_seeds << std::endl;
+
+	return write_outputs(options, shard_header{ gen.properties, gen.parameters, gen.stats(), { gen.properties.rng_stream } }, *image_ptr) ? 0 : 1;
+}
+
+// Render the seeds of a cache, which only traces the orbits accepted with the new parameters
+int run_replay(headless_options& options) {
+	seed_cache_reader reader;
+	if (!reader.open(options.replay)) {
+		std::cerr << "Cannot read seed cache " << options.replay << "\n";
+		return 1;
+	}
+	std::string reason;
+	if (!reader.header().replayable_with(options.parameters, reason)) {
+		std::cerr << "Cannot replay " << options.replay << " : " << reason << "\n";
+		return 1;
+	}
+
+	// the seeds were drawn by the recorded render, only the view and the sequence parameters can change
+	generator_properties properties { options.properties };
+	const generator_properties& recorded { reader.header().properties };
+	properties.seed_corner_a = recorded.seed_corner_a;
+	properties.seed_corner_b = recorded.seed_corner_b;
+	properties.sampler_t = recorded.sampler_t;
+	properties.rng_stream = recorded.rng_stream;
+
+	image img(properties.image_width, properties.image_height);
+	auto start { std::chrono::steady_clock::now() };
+	generator_stats stats { replay_seeds(reader, properties, options.parameters, img, options.runtime_parameters.threads_number) };
+	std::chrono::duration<double> elapsed { std::chrono::steady_clock::now() - start };
+	std::clog << "[replay " << elapsed.count() << "s] " << stats_to_string(stats, elapsed.count()) << std::endl;
+
+	return write_outputs(options, shard_header{ properties, options.parameters, stats, { properties.rng_stream } }, img) ? 0 : 1;
+}
+
+// Queue of render jobs sharing the threads. Jobs submitted to the directory while it runs are picked up, and an
+// interrupted queue is saved, to go on in the next run
+int run_jobs(headless_options& options) {
+	using namespace std::chrono_literals;
+
+	job_scheduler jobs(options.job_directory, options.runtime_parameters);
+	if (!options.submit.empty()) {
+		const generator_runtime_parameters& targets { options.runtime_parameters };
+		job_description job { options.submit, options.properties, options.parameters, targets.points_target, targets.time_budget_ms,
+		                      targets.accepted_orbits_target, targets.noise_target, options.priority, options.share };
+		if (!jobs.submit(job)) {
+			std::cerr << "Cannot submit job " << options.submit << " to " << options.job_directory << "\n";
+			return 1;
+		}
+		return 0;
+	}
+
+	auto start { std::chrono::steady_clock::now() };
+	auto last_log { start };
+	auto last_load { start };
+	auto last_save { start };
+	uint32_t threads { options.runtime_parameters.threads_number };
+	std::vector<job_info> last_infos;
+	auto log_changes = [&]{
+		std::vector<job_info> infos { jobs.jobs() };
+		for (size_t i { 0 } ; i < infos.size() ; i++) {
+			const job_info& info { infos[i] };
+			if (i < last_infos.size() && info.state == last_infos[i].state && info.threads == last_infos[i].threads)
+				continue;
+			std::clog << "Job " << info.name << ": " << job_state_to_string(info.state);
+			if (info.state == job_state::Running)
+				std::clog << " on " << info.threads << " threads";
+			if (info.state == job_state::Finished)
+				std::clog << ", " << info.stats.seeds << " seeds"
+				          << (info.reached != render_target::None ? ", " + std::string(target_to_string(info.reached)) + " reached" : "");
+			std::clog << std::endl;
+		}
+		last_infos = std::move(infos);
+	};
+
+	jobs.load();
+	while (!interrupted && jobs.update()) {
+		log_changes();
+
+		std::this_thread::sleep_for(100ms);
+		if (int change { threads_change.exchange(0) } ; change != 0) {
+			threads = std::max(1, static_cast<int>(threads) + change);
+			jobs.set_threads(threads);
+			std::clog << "Now running " << threads << " threads" << std::endl;
+		}
+
+		auto now { std::chrono::steady_clock::now() };
+		if (now - last_load >= 1s) {
+			jobs.load();
+			last_load = now;
+		}
+		std::chrono::duration<double> since_save { now - last_save };
+		if (since_save.count() >= options.checkpoint_interval) {
+			if (!jobs.save())
+				std::cerr << "Cannot save the jobs to " << options.job_directory << "\n";
+			last_save = now;
+		}
+		std::chrono::duration<double> since_log { now - last_log };
+		if (options.log_interval > 0. && since_log.count() >= options.log_interval) {
+			std::chrono::duration<double> elapsed { now - start };
+			std::clog << "[" << static_cast<Int>(elapsed.count()) << "s]" << std::endl;
+			for (auto& info : jobs.jobs())
+				if (info.state == job_state::Running)
+					std::clog << "  " << info.name << " (" << info.threads << " threads): "
+					          << stats_to_string(info.stats, info.running_ms / 1000.) << std::endl;
+			last_log = now;
+		}
+	}
+	log_changes();
+	std::chrono::duration<double> elapsed { std::chrono::steady_clock::now() - start };
+	std::clog << (interrupted ? "[interrupted " : "[total ") << elapsed.count() << "s] jobs saved in " << options.job_directory << std::endl;
+	return 0;
+}
+
+#ifdef BUDDHABROT_MULTIPROCESS
+extern char** environ;
+
+// Worker process: accumulates into the shared image the seeds granted by the coordinator
+int run_worker(headless_options& options) {
+	using namespace std::chrono_literals;
+
+	auto image_ptr { std::make_shared<shared_image>() };
+	coordinator_client client;
+	if (!image_ptr->attach(options.worker_image) || !client.connect(options.worker_socket)) {
+		std::cerr << "Worker " << getpid() << " cannot reach its coordinator\n";
+		return 1;
+	}
+
+	// a points target of 0 means no limit for the generator, so it is only created once a budget was granted
+	Int granted { client.request(worker_report{}).seeds };
+	if (granted == 0)
+		return 0;
+	Int last_grant { granted };
+	options.runtime_parameters.points_target = granted;
+	// the other targets are checked by the coordinator over every worker, which then reports more often
+	auto report_period { options.runtime_parameters.time_budget_ms != 0 || options.runtime_parameters.accepted_orbits_target != 0 ? 100ms : 1000ms };
+	options.runtime_parameters.time_budget_ms = 0;
+	options.runtime_parameters.accepted_orbits_target = 0;
+	generator gen(image_ptr, options.properties, options.parameters, options.runtime_parameters);
+	gen.resume();
+
+	// a new budget is requested as soon as less than a grant is left, so that the threads never run dry
+	bool over { false };
+	auto last_report { std::chrono::steady_clock::now() };
+	while (!interrupted) {
+		std::this_thread::sleep_for(50ms);
+		apply_threads_change(gen);
+		Int done { gen.total_progress().first };
+		if (over && done >= granted)
+			break;
+
+		bool wants_budget { !over && granted - done < last_grant };
+		auto now { std::chrono::steady_clock::now() };
+		if (!wants_budget && now - last_report < report_period)
+			continue;
+		last_report = now;
+
+		budget_grant grant { client.request(worker_report{ done, gen.stats(), wants_budget, false }) };
+		if (grant.stop)
+			break;
+		if (!wants_budget)
+			continue;
+		if (grant.seeds == 0)
+			over = true;
+		else {
+			granted += grant.seeds;
+			last_grant = grant.seeds;
+			gen.set_points_target(granted);
+		}
+	}
+	gen.stop();
+	client.request(worker_report{ gen.total_progress().first, gen.stats(), false, true });
+	return 0;
+}
+
+// Coordinator process: spawns the workers, hands out their budgets, and writes checkpoints and outputs
+int run_coordinator(headless_options& options, int argc, char** argv) {
+	const generator_properties& properties { options.properties };
+	generator_runtime_parameters& runtime_parameters { options.runtime_parameters };
+	if (!options.threads_set)
+		runtime_parameters.threads_number = std::max(1u, std::thread::hardware_concurrency() / options.processes);
+
+	const std::string id { "buddhabrot-" + std::to_string(getpid()) };
+	const std::string socket_path { "/tmp/" + id + ".sock" };
+	auto image_ptr { std::make_shared<shared_image>() };
+	coordinator coord;
+	if (!image_ptr->create("/" + id, properties.image_width, properties.image_height)) {
+		std::cerr << "Cannot create the shared memory object /" << id << "\n";
+		return 1;
+	}
+	if (!coord.listen(socket_path)) {
+		std::cerr << "Cannot listen on " << socket_path << "\n";
+		return 1;
+	}
+	// workers are granted seeds by chunks: small enough to balance the end of the render, large enough to limit messages
+	Int points_target { runtime_parameters.points_target };
+	coord.set_target(points_target, points_target ? std::max<Int>(1, points_target / (options.processes * 16)) : Int { 1 } << 24);
+
+	// every worker draws from its own RNG stream, derived from the stream of the render
+	Int stream { properties.rng_stream ? properties.rng_stream : std::random_device()() };
+	std::vector<Int> streams;
+	std::vector<pid_t> workers;
+	for (unsigned k { 0 } ; k < options.processes ; k++) {
+		streams.push_back(splitmix64(stream + k));
+		std::vector<std::string> args(argv, argv + argc);
+		args.insert(args.end(), { "--worker", socket_path, "/" + id, "--stream", std::to_string(streams.back()), "--threads", std::to_string(runtime_parameters.threads_number) });
+		std::vector<char*> c_args;
+		for (auto& arg : args)
+			c_args.push_back(arg.data());
+		c_args.push_back(nullptr);
+
+		pid_t pid;
+		if (posix_spawn(&pid, "/proc/self/exe", nullptr, nullptr, c_args.data(), environ) != 0) {
+			std::cerr << "Cannot spawn worker " << k << "\n";
+			break;
+		}
+		workers.push_back(pid);
+	}
+
+	shard_header header{ properties, options.parameters, {}, streams };
+	header.properties.rng_stream = stream;
+	auto write_checkpoint = [&]{
+		header.stats = coord.stats();
+		std::string temporary { options.checkpoint + ".tmp" };
+		if (!write_shard(temporary, header, *image_ptr) || std::rename(temporary.c_str(), options.checkpoint.c_str()) != 0)
+			std::cerr << "Cannot write checkpoint " << options.checkpoint << "\n";
+	};
+
+	auto start { std::chrono::steady_clock::now() };
+	auto last_log { start };
+	auto last_checkpoint { start };
+	generator_stats last_stats;
+	size_t exited { 0 };
+	render_target reached { render_target::None };
+	coord.serve(workers.size(), [&]{
+		if (interrupted)
+			coord.stop();
+
+		auto now { std::chrono::steady_clock::now() };
+		// the render is not deterministic, so the workers can leave the seeds they were granted once a target is reached
+		if (reached == render_target::None) {
+			if (runtime_parameters.time_budget_ms != 0 && now - start >= std::chrono::milliseconds(runtime_parameters.time_budget_ms))
+				reached = render_target::TimeBudget;
+			else if (runtime_parameters.accepted_orbits_target != 0 && coord.stats().accepted_orbits >= runtime_parameters.accepted_orbits_target)
+				reached = render_target::AcceptedOrbits;
+			if (reached != render_target::None)
+				coord.stop(true);
+		}
+		std::chrono::duration<double> since_log { now - last_log };
+		if (options.log_interval > 0. && since_log.count() >= options.log_interval) {
+			std::chrono::duration<double> elapsed { now - start };
+			log_delta("[" + std::to_string(static_cast<Int>(elapsed.count())) + "s] " + std::to_string(coord.seeds_done()) + " seeds, ", coord.stats(), last_stats, since_log.count());
+			last_log = now;
+		}
+		std::chrono::duration<double> since_checkpoint { now - last_checkpoint };
+		if (!options.checkpoint.empty() && since_checkpoint.count() >= options.checkpoint_interval) {
+			write_checkpoint();
+			last_checkpoint = now;
+		}
+
+		// stop serving if every worker exited, even those which never connected
+		while (exited < workers.size() && waitpid(-1, nullptr, WNOHANG) > 0)
+			exited++;
+		return exited < workers.size();
+	}, 0.1);
+	while (exited < workers.size() && waitpid(-1, nullptr, 0) > 0)
+		exited++;
+
+	std::chrono::duration<double> elapsed { std::chrono::steady_clock::now() - start };
+	std::clog << "[total " << elapsed.count() << "s] " << stats_to_string(coord.stats(), elapsed.count()) << std::endl;
+	if (reached != render_target::None)
+		std::clog << "Target reached: " << target_to_string(reached) << std::endl;
+
+	if (!options.checkpoint.empty())
+		write_checkpoint();
+	header.stats = coord.stats();
+	return write_outputs(options, header, *image_ptr) ? 0 : 1;
+}
+#endif
+
+int main(int argc, char** argv) {
+	headless_options options;
+	if (!parse_options(argc, argv, options) || !check_options(options))
+		return 1;
+
+	std::signal(SIGINT, [](int){ interrupted = true; });
+	std::signal(SIGTERM, [](int){ interrupted = true; });
+#ifdef SIGUSR1
+	std::signal(SIGUSR1, [](int){ threads_change++; });
+	std::signal(SIGUSR2, [](int){ threads_change--; });
+#endif
+	if (options.pool_threads != 0)
+		thread_pool::shared().set_capacity(options.pool_threads);
+
+	if (!options.job_directory.empty())
+		return run_jobs(options);
+#ifdef BUDDHABROT_MULTIPROCESS
+	if (!options.worker_socket.empty())
+		return run_worker(options);
+	if (options.processes > 0)
+		return run_coordinator(options, argc, argv);
+#endif
+	if (!options.replay.empty())
+		return run_replay(options);
+	return run_local(options);
+}
@@ -13,19 +13,24 @@ image::image(uint16_t w, uint16_t h) {
 std::vector<pixel> image::get_image() {
 	std::vector<pixel> image(this->m_width * this->m_height);
 	std::transform(data.begin(), data.end(), image.begin(), [&](Int e){
-		// uint8_t c = max ? e * 255 / max : 0;
-		uint8_t c = 0;
-		if (max) {
-			float frac = static_cast<double>(e) / max;
-			c = (- frac + 2 * std::sqrt(frac)) * 255;
-		}
-		// uint8_t c = 200;
+		uint8_t c = tone_map(e, max);
 		pixel p = { c, c, c };
 		return p;
 	});
 	return image;
 }
 
+uint8_t tone_map(Int e, Int max) {
+	// uint8_t c = max ? e * 255 / max : 0;
+	uint8_t c = 0;
+	if (max) {
+		float frac = static_cast<double>(e) / max;
+		c = (- frac + 2 * std::sqrt(frac)) * 255;
+	}
+	// uint8_t c = 200;
+	return c;
+}
+
 Int& image::at(uint16_t x, uint16_t y) {
 	return data.at(x + this->m_width * y);
 }
@@ -45,3 +50,22 @@ void image::incr(uint16_t x, uint16_t y) {
 	if (++at(x, y) > max)
 		max++;
 }
+
+void image::add(uint16_t x, uint16_t y, Int value) {
+	Int& e { at(x, y) };
+	e += value;
+	if (e > max)
+		max = e;
+}
+
+void image::flush_into(abstractImage& target) {
+	for (uint16_t y { 0 } ; y < m_height ; y++)
+		for (uint16_t x { 0 } ; x < m_width ; x++) {
+			Int& e { data[x + m_width * y] };
+			if (e == 0)
+				continue;
+			target.add(x, y, e);
+			e = 0;
+		}
+	max = 0;
+}
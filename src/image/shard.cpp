@@ -0,0 +1,180 @@
+#include "image/shard.h"
+
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+namespace {
+	constexpr char magic[8] { 'B', 'B', 'S', 'H', 'A', 'R', 'D', '\0' };
+	constexpr uint32_t version { 4 };
+
+	template<typename T>
+	void write_value(std::ostream& stream, const T& value) {
+		stream.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template<typename T>
+	void read_value(std::istream& stream, T& value) {
+		stream.read(reinterpret_cast<char*>(&value), sizeof(T));
+	}
+
+	// The same field list is used to write and to read a header, so both can never diverge
+	template<typename stream_t, typename header_t, typename fn_t>
+	void for_each_field(stream_t& stream, header_t& h, fn_t fn) {
+		fn(stream, h.properties.image_width);
+		fn(stream, h.properties.image_height);
+		Real a_real { h.properties.corner_a.real() }, a_imag { h.properties.corner_a.imag() };
+		Real b_real { h.properties.corner_b.real() }, b_imag { h.properties.corner_b.imag() };
+		fn(stream, a_real);
+		fn(stream, a_imag);
+		fn(stream, b_real);
+		fn(stream, b_imag);
+		Real seed_a_real { h.properties.seed_corner_a.real() }, seed_a_imag { h.properties.seed_corner_a.imag() };
+		Real seed_b_real { h.properties.seed_corner_b.real() }, seed_b_imag { h.properties.seed_corner_b.imag() };
+		fn(stream, seed_a_real);
+		fn(stream, seed_a_imag);
+		fn(stream, seed_b_real);
+		fn(stream, seed_b_imag);
+		if constexpr (!std::is_const_v<header_t>) {
+			h.properties.corner_a = std::complex<Real>(a_real, a_imag);
+			h.properties.corner_b = std::complex<Real>(b_real, b_imag);
+			h.properties.seed_corner_a = std::complex<Real>(seed_a_real, seed_a_imag);
+			h.properties.seed_corner_b = std::complex<Real>(seed_b_real, seed_b_imag);
+		}
+		fn(stream, h.properties.sampler_t);
+		fn(stream, h.properties.layers);
+		fn(stream, h.properties.layer_resolution);
+		fn(stream, h.properties.deterministic);
+		fn(stream, h.properties.first_seed_index);
+		fn(stream, h.properties.pilot_resolution);
+		fn(stream, h.properties.pilot_seeds);
+
+		fn(stream, h.parameters.iterations_to_escape);
+		fn(stream, h.parameters.minimum_iterations);
+		fn(stream, h.parameters.escape_norm);
+		fn(stream, h.parameters.y_symetry);
+
+		fn(stream, h.stats.seeds);
+		fn(stream, h.stats.cardioid_rejects);
+		fn(stream, h.stats.non_escaping_rejects);
+		fn(stream, h.stats.below_minimum_rejects);
+		fn(stream, h.stats.accepted_orbits);
+		fn(stream, h.stats.missed_view_orbits);
+		fn(stream, h.stats.orbit_points);
+		fn(stream, h.stats.points_in_view);
+		fn(stream, h.stats.lock_wait_ns);
+	}
+}
+
+bool shard_header::compatible_with(const shard_header& other, std::string& reason) const {
+	const generator_properties& p { properties };
+	const generator_properties& q { other.properties };
+	if (p.image_width != q.image_width || p.image_height != q.image_height)
+		reason = "image sizes differ";
+	else if (p.corner_a != q.corner_a || p.corner_b != q.corner_b)
+		reason = "rendered regions differ";
+	else if (p.seed_corner_a != q.seed_corner_a || p.seed_corner_b != q.seed_corner_b)
+		reason = "seed domains differ";
+	else if (p.sampler_t != q.sampler_t || p.layers != q.layers || p.layer_resolution != q.layer_resolution || p.deterministic != q.deterministic
+	||       p.pilot_resolution != q.pilot_resolution || p.pilot_seeds != q.pilot_seeds)
+		reason = "samplers differ";
+	else if (parameters.iterations_to_escape != other.parameters.iterations_to_escape
+	||       parameters.minimum_iterations != other.parameters.minimum_iterations
+	||       parameters.escape_norm != other.parameters.escape_norm
+	||       parameters.y_symetry != other.parameters.y_symetry)
+		reason = "sequence parameters differ";
+	else if (p.deterministic) {
+		// a deterministic render is split by ranges of seed indices, which must follow each other to be merged
+		if (streams != other.streams)
+			reason = "RNG streams differ";
+		else if (p.first_seed_index + stats.seeds != q.first_seed_index && q.first_seed_index + other.stats.seeds != p.first_seed_index)
+			reason = "seed ranges are not contiguous";
+		else
+			return true;
+	}
+	else {
+		for (Int stream : streams)
+			if (std::find(other.streams.begin(), other.streams.end(), stream) != other.streams.end()) {
+				reason = "RNG stream " + std::to_string(stream) + " was used by both shards";
+				return false;
+			}
+		return true;
+	}
+	return false;
+}
+
+bool shard_writer::open(const std::string& path, const shard_header& header_in) {
+	header = header_in;
+	file.open(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+		return false;
+
+	file.write(magic, sizeof(magic));
+	write_value(file, version);
+	write_shard_header(file, header);
+	return static_cast<bool>(file);
+}
+
+bool shard_writer::write_rows(const Int* counters, size_t rows) {
+	file.write(reinterpret_cast<const char*>(counters), rows * header.properties.image_width * sizeof(Int));
+	return static_cast<bool>(file);
+}
+
+bool shard_writer::close() {
+	file.close();
+	return !file.fail();
+}
+
+bool shard_reader::open(const std::string& path) {
+	file.open(path, std::ios::binary);
+	if (!file)
+		return false;
+
+	char file_magic[sizeof(magic)];
+	uint32_t file_version;
+	file.read(file_magic, sizeof(file_magic));
+	read_value(file, file_version);
+	if (!file || std::memcmp(file_magic, magic, sizeof(magic)) != 0 || file_version != version)
+		return false;
+
+	return read_shard_header(file, m_header);
+}
+
+bool shard_reader::read_rows(Int* counters, size_t rows) {
+	file.read(reinterpret_cast<char*>(counters), rows * m_header.properties.image_width * sizeof(Int));
+	return static_cast<bool>(file);
+}
+
+void write_shard_header(std::ostream& stream, const shard_header& header) {
+	for_each_field(stream, header, [](std::ostream& s, const auto& v){ write_value(s, v); });
+	write_value(stream, static_cast<Int>(header.streams.size()));
+	for (Int s : header.streams)
+		write_value(stream, s);
+}
+
+bool read_shard_header(std::istream& stream, shard_header& header) {
+	for_each_field(stream, header, [](std::istream& s, auto& v){ read_value(s, v); });
+	Int streams_count { 0 };
+	read_value(stream, streams_count);
+	if (!stream)
+		return false;
+	header.streams.resize(streams_count);
+	for (Int& s : header.streams)
+		read_value(stream, s);
+	return static_cast<bool>(stream);
+}
+
+bool write_shard(const std::string& path, const shard_header& header, abstractImage& img) {
+	shard_writer writer;
+	if (!writer.open(path, header))
+		return false;
+
+	std::vector<Int> row(img.width());
+	for (uint16_t y { 0 } ; y < img.height() ; y++) {
+		for (uint16_t x { 0 } ; x < img.width() ; x++)
+			row[x] = img.read(x, y);
+		if (!writer.write_rows(row.data(), 1))
+			return false;
+	}
+	return writer.close();
+}
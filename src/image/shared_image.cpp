@@ -0,0 +1,115 @@
+#include "image/shared_image.h"
+
+#include <algorithm>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(std::atomic<Int>::is_always_lock_free, "counters must be lock-free to be shared between processes");
+
+namespace {
+	constexpr uint64_t shared_image_magic { 0x4242534841524544 }; // "BBSHARED"
+	// counters start on their own cache line, after the header
+	constexpr size_t data_offset { cache_line_size };
+}
+
+shared_image::~shared_image() {
+	if (mapping)
+		munmap(mapping, mapping_size);
+	if (owner)
+		shm_unlink(name.c_str());
+}
+
+bool shared_image::map(int fd, size_t size) {
+	mapping = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) {
+		mapping = nullptr;
+		return false;
+	}
+	mapping_size = size;
+	data = reinterpret_cast<std::atomic<Int>*>(static_cast<char*>(mapping) + data_offset);
+	return true;
+}
+
+bool shared_image::create(const std::string& name_in, uint16_t width, uint16_t height) {
+	name = name_in;
+	int fd { shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600) };
+	if (fd < 0)
+		return false;
+	owner = true;
+
+	size_t size { data_offset + static_cast<size_t>(width) * height * sizeof(Int) };
+	if (ftruncate(fd, size) != 0) { // the new object is zero-filled
+		close(fd);
+		return false;
+	}
+	if (!map(fd, size))
+		return false;
+
+	header* h { static_cast<header*>(mapping) };
+	h->width = width;
+	h->height = height;
+	h->magic = shared_image_magic;
+	m_width = width;
+	m_height = height;
+	return true;
+}
+
+bool shared_image::attach(const std::string& name_in) {
+	name = name_in;
+	int fd { shm_open(name.c_str(), O_RDWR, 0) };
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < data_offset) {
+		close(fd);
+		return false;
+	}
+	if (!map(fd, st.st_size))
+		return false;
+
+	header* h { static_cast<header*>(mapping) };
+	if (h->magic != shared_image_magic || data_offset + static_cast<size_t>(h->width) * h->height * sizeof(Int) > mapping_size)
+		return false;
+	m_width = h->width;
+	m_height = h->height;
+	return true;
+}
+
+std::atomic<Int>& shared_image::at(uint16_t x, uint16_t y) {
+	return data[x + static_cast<size_t>(m_width) * y];
+}
+
+Int shared_image::read(uint16_t x, uint16_t y) {
+	return at(x, y).load(std::memory_order_relaxed);
+}
+
+void shared_image::set(uint16_t x, uint16_t y, Int value) {
+	at(x, y).store(value, std::memory_order_relaxed);
+}
+
+void shared_image::incr(uint16_t x, uint16_t y) {
+	at(x, y).fetch_add(1, std::memory_order_relaxed);
+}
+
+void shared_image::add(uint16_t x, uint16_t y, Int value) {
+	at(x, y).fetch_add(value, std::memory_order_relaxed);
+}
+
+std::vector<pixel> shared_image::get_image() {
+	size_t size { static_cast<size_t>(m_width) * m_height };
+	Int max { 0 };
+	for (size_t i { 0 } ; i < size ; i++)
+		max = std::max(max, data[i].load(std::memory_order_relaxed));
+
+	std::vector<pixel> res(size);
+	for (size_t i { 0 } ; i < size ; i++) {
+		uint8_t c { tone_map(data[i].load(std::memory_order_relaxed), max) };
+		res[i] = { c, c, c };
+	}
+	return res;
+}
@@ -0,0 +1,132 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "image/abstract_image.h"
+#include "image/shard.h"
+#include "types.h"
+
+// Rows are merged by chunks of about this many bytes per shard, so that memory does not depend on the image size
+constexpr size_t chunk_bytes { 4 << 20 };
+
+void usage(const char* program) {
+	std::cerr << "Usage: " << program << " [--pgm FILE] OUTPUT INPUT...\n"
+	          << "  Sum the histograms of the INPUT shards of a render into the OUTPUT shard.\n"
+	          << "  --pgm FILE  also write the merged image as a binary PGM file\n";
+}
+
+bool write_pgm(const std::string& shard_path, const std::string& pgm_path, Int max) {
+	shard_reader reader;
+	std::ofstream file(pgm_path, std::ios::binary);
+	if (!reader.open(shard_path) || !file)
+		return false;
+
+	const generator_properties& properties { reader.header().properties };
+	file << "P5\n" << properties.image_width << " " << properties.image_height << "\n255\n";
+	std::vector<Int> row(properties.image_width);
+	for (uint16_t y { 0 } ; y < properties.image_height ; y++) {
+		if (!reader.read_rows(row.data(), 1))
+			return false;
+		for (Int e : row)
+			file.put(static_cast<char>(tone_map(e, max)));
+	}
+	return static_cast<bool>(file);
+}
+
+int main(int argc, char** argv) {
+	std::string pgm;
+	std::vector<std::string> paths;
+	for (int i { 1 } ; i < argc ; i++) {
+		std::string arg { argv[i] };
+		if (arg == "--pgm" && i + 1 < argc)
+			pgm = argv[++i];
+		else
+			paths.push_back(arg);
+	}
+	if (paths.size() < 2) {
+		usage(argv[0]);
+		return 1;
+	}
+	std::string output { paths.front() };
+	paths.erase(paths.begin());
+
+	// open every shard and check that they belong to the same render
+	std::vector<std::unique_ptr<shard_reader>> readers;
+	for (auto& path : paths) {
+		readers.push_back(std::make_unique<shard_reader>());
+		if (!readers.back()->open(path)) {
+			std::cerr << "Cannot read shard " << path << "\n";
+			return 1;
+		}
+	}
+	// the ranges of seeds of a deterministic render are checked in order, whatever the order of the arguments
+	std::vector<size_t> order(readers.size());
+	for (size_t i { 0 } ; i < order.size() ; i++)
+		order[i] = i;
+	if (readers.front()->header().properties.deterministic)
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b){
+			return readers[a]->header().properties.first_seed_index < readers[b]->header().properties.first_seed_index;
+		});
+
+	shard_header merged { readers[order.front()]->header() };
+	for (size_t i : order) {
+		const shard_header& header { readers[i]->header() };
+		if (i == order.front())
+			continue;
+		std::string reason;
+		if (!merged.compatible_with(header, reason)) {
+			std::cerr << "Cannot merge " << paths[i] << " : " << reason << "\n";
+			return 1;
+		}
+		merged.stats += header.stats;
+		if (merged.properties.deterministic)
+			merged.properties.first_seed_index = std::min(merged.properties.first_seed_index, header.properties.first_seed_index);
+		else
+			merged.streams.insert(merged.streams.end(), header.streams.begin(), header.streams.end());
+	}
+
+	shard_writer writer;
+	if (!writer.open(output, merged)) {
+		std::cerr << "Cannot write " << output << "\n";
+		return 1;
+	}
+
+	const uint16_t width { merged.properties.image_width };
+	const uint16_t height { merged.properties.image_height };
+	size_t chunk_rows { std::max<size_t>(1, chunk_bytes / (width * sizeof(Int))) };
+	std::vector<Int> sum(chunk_rows * width);
+	std::vector<Int> chunk(chunk_rows * width);
+	Int max { 0 };
+	for (size_t y { 0 } ; y < height ; y += chunk_rows) {
+		size_t rows { std::min<size_t>(chunk_rows, height - y) };
+		std::fill(sum.begin(), sum.end(), 0);
+		for (size_t i { 0 } ; i < readers.size() ; i++) {
+			if (!readers[i]->read_rows(chunk.data(), rows)) {
+				std::cerr << "Shard " << paths[i] << " is truncated\n";
+				return 1;
+			}
+			for (size_t j { 0 } ; j < rows * width ; j++)
+				sum[j] += chunk[j];
+		}
+		max = std::max(max, *std::max_element(sum.begin(), sum.begin() + rows * width));
+		if (!writer.write_rows(sum.data(), rows)) {
+			std::cerr << "Cannot write " << output << "\n";
+			return 1;
+		}
+	}
+	if (!writer.close()) {
+		std::cerr << "Cannot write " << output << "\n";
+		return 1;
+	}
+
+	std::clog << "Merged " << readers.size() << " shards: " << merged.stats.seeds << " seeds, " << merged.stats.accepted_orbits << " accepted orbits\n";
+
+	if (!pgm.empty() && !write_pgm(output, pgm, max)) {
+		std::cerr << "Cannot write " << pgm << "\n";
+		return 1;
+	}
+	return 0;
+}
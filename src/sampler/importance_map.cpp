@@ -0,0 +1,195 @@
+#include "sampler/importance_map.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <random>
+
+#include "generator/thread_pool.h"
+#include "helper.h"
+#include "mandelbrot_helper.h"
+
+namespace {
+	constexpr char magic[8] { 'B', 'B', 'I', 'M', 'A', 'P', '\0', '\0' };
+	constexpr uint32_t version { 1 };
+	// the floor of every cell's importance, relatively to the mean importance
+	constexpr Real defensive_share { 0.1 };
+}
+
+std::shared_ptr<const importance_map> importance_map::load_or_build(std::complex<Real> seed_a, std::complex<Real> seed_b,
+                                                                    const generator_properties& properties, const generator_parameters& parameters,
+                                                                    uint32_t threads_number, const std::string& directory) {
+	uint32_t resolution { static_cast<uint32_t>(std::clamp<Int>(properties.pilot_resolution, 1, 4096)) };
+	Int pilot_seeds { std::max<Int>(1, properties.pilot_seeds) };
+
+	Int key { splitmix64(version) };
+	for (Real value : { seed_a.real(), seed_a.imag(), seed_b.real(), seed_b.imag(),
+	                    properties.corner_a.real(), properties.corner_a.imag(), properties.corner_b.real(), properties.corner_b.imag(), parameters.escape_norm })
+		key = hash_combine(key, value);
+	for (Int value : { parameters.iterations_to_escape, parameters.minimum_iterations, static_cast<Int>(parameters.y_symetry),
+	                   static_cast<Int>(resolution), pilot_seeds })
+		key = hash_combine(key, value);
+
+	std::shared_ptr<importance_map> map { new importance_map(key, resolution) };
+	char name[64];
+	std::snprintf(name, sizeof(name), "/importance-%016llx.map", static_cast<unsigned long long>(key));
+	std::string path { directory.empty() ? std::string() : directory + name };
+	if (!path.empty() && map->load(path))
+		return map;
+
+	map->pilot(seed_a, seed_b, properties, parameters, threads_number, pilot_seeds);
+	// another process may be writing the same map, each one writes its own file then renames it
+	if (!path.empty()) {
+		std::string temporary { path + "." + std::to_string(std::random_device()()) };
+		if (map->save(temporary))
+			std::rename(temporary.c_str(), path.c_str());
+		else
+			std::remove(temporary.c_str());
+	}
+	return map;
+}
+
+void importance_map::pilot(std::complex<Real> seed_a, std::complex<Real> seed_b, const generator_properties& properties,
+                           const generator_parameters& parameters, uint32_t threads_number, Int pilot_seeds) {
+	auto [seed_real_m, seed_real_M] = minmax(seed_a.real(), seed_b.real());
+	auto [seed_imag_m, seed_imag_M] = minmax(seed_a.imag(), seed_b.imag());
+	Real cell_width { (seed_real_M - seed_real_m) / m_resolution };
+	Real cell_height { (seed_imag_M - seed_imag_m) / m_resolution };
+	Real real_m = properties.corner_a.real();
+	Real real_M = properties.corner_b.real();
+	Real imag_m = properties.corner_a.imag();
+	Real imag_M = properties.corner_b.imag();
+
+	// points in view of the orbit of z0, or 0 if it is not accepted
+	auto contribution = [&](std::complex<Real> z0) {
+		if (insideCardioids(z0))
+			return Int { 0 };
+		Int i { escape_iterations(z0, parameters.iterations_to_escape, parameters.escape_norm) };
+		if (i == parameters.iterations_to_escape || i < parameters.minimum_iterations)
+			return Int { 0 };
+		Int points { 0 };
+		std::complex<Real> z { z0 };
+		for (Int k { 0 } ; k < i ; k++, z = z * z + z0) {
+			bool in_real { real_m <= z.real() && z.real() < real_M };
+			points += in_real && imag_m <= z.imag() && z.imag() < imag_M;
+			if (parameters.y_symetry)
+				points += in_real && imag_m <= -z.imag() && -z.imag() < imag_M;
+		}
+		return points;
+	};
+
+	// seeds are jittered in their cell by a hash of their position
+	std::vector<Real> raw(static_cast<size_t>(m_resolution) * m_resolution);
+	auto trace_row = [&](uint32_t y) {
+		for (uint32_t x { 0 } ; x < m_resolution ; x++) {
+			size_t cell { x + static_cast<size_t>(m_resolution) * y };
+			Int points { 0 };
+			for (Int s { 0 } ; s < pilot_seeds ; s++) {
+				Int h { splitmix64(key + 2 * (cell * pilot_seeds + s)) };
+				std::complex<Real> z0 { seed_real_m + (x + to_unit(h)) * cell_width, seed_imag_m + (y + to_unit(splitmix64(h))) * cell_height };
+				points += contribution(z0);
+			}
+			raw[cell] = static_cast<Real>(points) / pilot_seeds;
+		}
+	};
+
+	// rows are handed out to this thread and to jobs of the shared pool. The pool may queue the jobs until after the
+	// pass, so they only share the rows' state, and this thread only waits for the rows they took
+	struct row_state {
+		std::atomic<uint32_t> next { 0 };
+		uint32_t done { 0 }; // guarded by mutex
+		std::mutex mutex;
+		std::condition_variable all_done;
+	};
+	auto rows { std::make_shared<row_state>() };
+	uint32_t row_count { m_resolution };
+	auto task = [rows, row_count, &trace_row]{
+		for (uint32_t y ; (y = rows->next.fetch_add(1)) < row_count ; ) {
+			trace_row(y);
+			std::lock_guard<std::mutex> lock(rows->mutex);
+			if (++rows->done == row_count)
+				rows->all_done.notify_all();
+		}
+	};
+	for (uint32_t t { 1 } ; t < threads_number ; t++)
+		thread_pool::shared().submit(task);
+	task();
+	std::unique_lock<std::mutex> lock(rows->mutex);
+	rows->all_done.wait(lock, [&]{ return rows->done == row_count; });
+
+	// a few seeds per cell only hint at where orbits cross the view, so the estimates are spread over the neighbours
+	importance.assign(raw.size(), 0.);
+	int r { static_cast<int>(m_resolution) };
+	for (int y { 0 } ; y < r ; y++) {
+		for (int x { 0 } ; x < r ; x++) {
+			Real sum { 0. };
+			int cells { 0 };
+			for (int ny { std::max(0, y - 1) } ; ny <= std::min(r - 1, y + 1) ; ny++)
+				for (int nx { std::max(0, x - 1) } ; nx <= std::min(r - 1, x + 1) ; nx++, cells++)
+					sum += raw[nx + static_cast<size_t>(r) * ny];
+			importance[x + static_cast<size_t>(r) * y] = sum / cells;
+		}
+	}
+	Real mean { 0. };
+	for (Real e : importance)
+		mean += e / importance.size();
+	for (Real& e : importance)
+		e = mean == 0. ? 1. : e + defensive_share * mean;
+	finish();
+}
+
+void importance_map::finish() {
+	cdf.resize(importance.size());
+	weights.resize(importance.size());
+	Real sum { 0. }, max { 0. };
+	for (size_t i { 0 } ; i < importance.size() ; i++) {
+		sum += importance[i];
+		cdf[i] = sum;
+		max = std::max(max, importance[i]);
+	}
+	for (size_t i { 0 } ; i < importance.size() ; i++) {
+		cdf[i] /= sum;
+		weights[i] = max / importance[i];
+	}
+	cdf.back() = 1.;
+}
+
+size_t importance_map::cell_of(Real u) const {
+	size_t cell { static_cast<size_t>(std::upper_bound(cdf.begin(), cdf.end(), u) - cdf.begin()) };
+	return std::min(cell, cdf.size() - 1);
+}
+
+bool importance_map::load(const std::string& path) {
+	std::ifstream file(path, std::ios::binary);
+	char file_magic[sizeof(magic)];
+	uint32_t file_version, file_resolution;
+	Int file_key;
+	file.read(file_magic, sizeof(file_magic));
+	file.read(reinterpret_cast<char*>(&file_version), sizeof(file_version));
+	file.read(reinterpret_cast<char*>(&file_key), sizeof(file_key));
+	file.read(reinterpret_cast<char*>(&file_resolution), sizeof(file_resolution));
+	if (!file || std::memcmp(file_magic, magic, sizeof(magic)) != 0 || file_version != version || file_key != key || file_resolution != m_resolution)
+		return false;
+
+	importance.resize(static_cast<size_t>(m_resolution) * m_resolution);
+	file.read(reinterpret_cast<char*>(importance.data()), importance.size() * sizeof(Real));
+	if (!file || std::any_of(importance.begin(), importance.end(), [](Real e){ return !(e > 0.); }))
+		return false;
+	finish();
+	return true;
+}
+
+// Layout, in the host's byte order: "BBIMAP" magic, format version, key, resolution, then the importance of the cells
+bool importance_map::save(const std::string& path) const {
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.write(magic, sizeof(magic));
+	file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+	file.write(reinterpret_cast<const char*>(&key), sizeof(key));
+	file.write(reinterpret_cast<const char*>(&m_resolution), sizeof(m_resolution));
+	file.write(reinterpret_cast<const char*>(importance.data()), importance.size() * sizeof(Real));
+	return static_cast<bool>(file.flush());
+}
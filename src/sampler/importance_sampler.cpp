@@ -0,0 +1,28 @@
+#include "sampler/importance_sampler.h"
+
+#include <utility>
+
+#include "helper.h"
+
+importance_sampler::importance_sampler(std::complex<Real> corner_a, std::complex<Real> corner_b, std::shared_ptr<const importance_map> map, Int stream) :
+	map(std::move(map)),
+	key(splitmix64(stream))
+{
+	auto [real_m, real_M] = minmax(corner_a.real(), corner_b.real());
+	auto [imag_m, imag_M] = minmax(corner_a.imag(), corner_b.imag());
+	this->corner_a = std::complex(real_m, imag_m);
+	this->corner_b = std::complex(real_M, imag_M);
+}
+
+std::complex<Real> importance_sampler::draw(Int index, Int& weight) {
+	Int h { key + 4 * index };
+	size_t cell { map->cell_of(to_unit(splitmix64(h))) };
+	uint32_t resolution { map->resolution() };
+	Real x = (cell % resolution + to_unit(splitmix64(h + 1))) / resolution;
+	Real y = (cell / resolution + to_unit(splitmix64(h + 2))) / resolution;
+	Real real = corner_a.real() + x * (corner_b.real() - corner_a.real());
+	Real imag = corner_a.imag() + y * (corner_b.imag() - corner_a.imag());
+	// the weight is rounded at random, so that its expectation is the cell's weight
+	weight = static_cast<Int>(map->weight(cell) + to_unit(splitmix64(h + 3)));
+	return std::complex(real, imag);
+}
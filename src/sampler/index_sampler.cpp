@@ -0,0 +1,19 @@
+#include "sampler/index_sampler.h"
+
+#include "helper.h"
+
+index_sampler::index_sampler(std::complex<Real> corner_a, std::complex<Real> corner_b, Int stream) :
+	key(splitmix64(stream))
+{
+	auto [real_m, real_M] = minmax(corner_a.real(), corner_b.real());
+	auto [imag_m, imag_M] = minmax(corner_a.imag(), corner_b.imag());
+	this->corner_a = std::complex(real_m, imag_m);
+	this->corner_b = std::complex(real_M, imag_M);
+}
+
+std::complex<Real> index_sampler::draw(Int index, Int& weight) {
+	Real real = corner_a.real() + to_unit(splitmix64(key + 2 * index)) * (corner_b.real() - corner_a.real());
+	Real imag = corner_a.imag() + to_unit(splitmix64(key + 2 * index + 1)) * (corner_b.imag() - corner_a.imag());
+	weight = 1;
+	return std::complex(real, imag);
+}
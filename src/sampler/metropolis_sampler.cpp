@@ -0,0 +1,57 @@
+#include "sampler/metropolis_sampler.h"
+
+#include <cmath>
+
+metropolis_sampler::metropolis_sampler(std::complex<Real> view_corner_a, std::complex<Real> view_corner_b,
+                                       std::complex<Real> seed_corner_a, std::complex<Real> seed_corner_b, Int seed) :
+	engine(seed),
+	unit(0., 1.),
+	seed_corner_a(seed_corner_a),
+	seed_size(seed_corner_b - seed_corner_a)
+{
+	Real view_size { std::abs(view_corner_b - view_corner_a) };
+	min_radius = view_size * 1e-4;
+	max_radius = view_size * 0.1;
+}
+
+std::complex<Real> metropolis_sampler::propose() {
+	// until a contributing seed is found, the chain only draws large mutations
+	if (current_contribution == 0 || unit(engine) < large_mutation_probability) {
+		proposal = seed_corner_a + std::complex<Real>(seed_size.real() * unit(engine), seed_size.imag() * unit(engine));
+		return proposal;
+	}
+	// the radius is log-uniform, to explore both the neighbouring pixels and the structures of the view
+	Real radius { max_radius * std::exp(-std::log(max_radius / min_radius) * unit(engine)) };
+	proposal = current + std::polar(radius, 2. * M_PI * unit(engine));
+	return proposal;
+}
+
+bool metropolis_sampler::accept(Int contribution) {
+	// the stationary density is 0 outside the seed domain, which a small mutation may leave
+	std::complex<Real> offset { proposal - seed_corner_a };
+	Real u { offset.real() / seed_size.real() };
+	Real v { offset.imag() / seed_size.imag() };
+	if (!(0. <= u && u < 1. && 0. <= v && v < 1.))
+		contribution = 0;
+	if (contribution == 0 && current_contribution != 0)
+		return false;
+	if (current_contribution != 0 && contribution < current_contribution
+	&&  unit(engine) * current_contribution >= contribution)
+		return false;
+	current = proposal;
+	current_contribution = contribution;
+	return true;
+}
+
+Int metropolis_sampler::whole_weight() const {
+	return splat_weight / current_contribution;
+}
+
+Int metropolis_sampler::extra_points() {
+	// the remainder of the weight, spread over the orbit, is (splat_weight % contribution) / contribution per point
+	return splat_weight % current_contribution;
+}
+
+Int metropolis_sampler::pick_point() {
+	return std::uniform_int_distribution<Int>(0, current_contribution - 1)(engine);
+}
@@ -1,9 +1,19 @@
 #include "sampler/monte_carlo_sampler.h"
 
+#include <utility>
+
 #include "helper.h"
 
-monte_carlo_sampler::monte_carlo_sampler(std::complex<Real> corner_a, std::complex<Real> corner_b, Int layers, Int layer_resolution) :
-	tree(layers, layer_resolution)
+monte_carlo_sampler::monte_carlo_sampler(std::complex<Real> corner_a, std::complex<Real> corner_b, Int layers, Int layer_resolution, Int max_nodes) :
+	monte_carlo_sampler(corner_a, corner_b, layers, layer_resolution, max_nodes, std::random_device()())
+{}
+
+monte_carlo_sampler::monte_carlo_sampler(std::complex<Real> corner_a, std::complex<Real> corner_b, Int layers, Int layer_resolution, Int max_nodes, Int seed) :
+	monte_carlo_sampler(corner_a, corner_b, std::make_shared<monte_carlo_tree>(layers, layer_resolution, max_nodes), seed)
+{}
+
+monte_carlo_sampler::monte_carlo_sampler(std::complex<Real> corner_a, std::complex<Real> corner_b, std::shared_ptr<monte_carlo_tree> tree, Int seed) :
+	tree(std::move(tree))
 {
 	// TODO : could be supposed as correct and make this transormation once during the generator creation
 	auto [real_m, real_M] = minmax(corner_a.real(), corner_b.real());
@@ -11,13 +21,12 @@ monte_carlo_sampler::monte_carlo_sampler(std::complex<Real> corner_a, std::compl
 	this->corner_a = std::complex(real_m, imag_m);
 	this->corner_b = std::complex(real_M, imag_M);
 
-	engine = std::ranlux48(rd());
-	this->layers = layers;
-	this->layer_resolution = layer_resolution;
+	engine = std::ranlux48(seed);
 }
 
-sample_result monte_carlo_sampler::sample() {
-	monte_carlo_tree::path path = tree.sample_path();
+sample_result monte_carlo_sampler::sample(Int) {
+	monte_carlo_tree::path path = tree->sample_path();
+	const Int layer_resolution = tree->resolution();
 	monte_carlo_tree::path new_path;
 
 	std::complex<Real> shrinking_corner_a = corner_a;
@@ -52,7 +61,7 @@ sample_result monte_carlo_sampler::sample() {
 
 	auto feedback = [this](std::shared_ptr<void> data_ptr, Int success, Int total){
 		monte_carlo_tree::path* p = reinterpret_cast<monte_carlo_tree::path*>(data_ptr.get());
-		this->tree.feedback(*p, success, total);
+		this->tree->feedback(*p, success, total);
 	};
 
 	return sample_result{ res, data_ptr, feedback };
@@ -2,82 +2,237 @@
 
 #include <algorithm>
 #include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+
+namespace {
+	constexpr size_t chunk_nodes { 4096 };
+
+	constexpr char magic[8] { 'B', 'B', 'M', 'C', 'T', 'R', 'E', 'E' };
+	constexpr uint32_t version { 1 };
+
+	// a node of a saved tree, its children follow it when it has some
+	struct saved_node {
+		Int success;
+		Int total;
+		uint32_t visits;
+		uint32_t has_children;
+	};
+}
 
-#include <iostream>
+monte_carlo_tree::monte_carlo_tree(uint16_t layers, uint16_t layer_resolution, Int max_nodes) :
+	layers(layers),
+	layer_resolution(layer_resolution),
+	block_size(static_cast<size_t>(layer_resolution) * layer_resolution),
+	blocks_per_chunk(std::max<size_t>(1, chunk_nodes / block_size)),
+	max_blocks(static_cast<uint32_t>(std::min<Int>(UINT32_MAX - 1, max_nodes > 0 ? (max_nodes - 1) / block_size : 0)))
+{
+	chunks.resize((max_blocks + blocks_per_chunk - 1) / blocks_per_chunk);
+}
 
-monte_carlo_tree::monte_carlo_tree(uint16_t layers, uint16_t layer_resolution) : root(this, nullptr, layers, layer_resolution) {
-	total = 0;
+monte_carlo_tree::node& monte_carlo_tree::child(uint32_t block, size_t i) const {
+	size_t b { block - 1 };
+	return chunks[b / blocks_per_chunk][(b % blocks_per_chunk) * block_size + i];
 }
 
-monte_carlo_tree::path monte_carlo_tree::sample_path() {
+monte_carlo_tree::path monte_carlo_tree::sample_path() const {
 	path p;
-	root.sample(p);
+	const node* n { &root };
+	for (uint32_t block ; (block = n->first_child.load(std::memory_order_acquire)) != no_children ; ) {
+		Int parent_total { n->total.load(std::memory_order_relaxed) };
+		size_t best { 0 };
+		double best_score { -1. };
+		for (size_t i { 0 } ; i < block_size ; i++) {
+			double score { child(block, i).score(parent_total) };
+			if (score > best_score) {
+				best_score = score;
+				best = i;
+			}
+		}
+		p.push({ best / layer_resolution, best % layer_resolution });
+		n = &child(block, best);
+	}
 	return p;
 }
 
 void monte_carlo_tree::feedback(path& p, Int success, Int total) {
-	this->total += total;
+	node* n { &root };
+	for (uint16_t depth { 0 } ; ; depth++) {
+		// success may be read without its total, which only makes the score slightly off
+		Int n_success { n->success.fetch_add(success, std::memory_order_relaxed) + success };
+		n->total.fetch_add(total, std::memory_order_relaxed);
+		uint32_t visits { n->visits.fetch_add(1, std::memory_order_relaxed) + 1 };
+
+		uint32_t block { n->first_child.load(std::memory_order_acquire) };
+		if (block == no_children) {
+			// the path may be longer than the tree if its cell was merged meanwhile
+			if (depth < layers && visits >= split_visits && n_success != 0)
+				split(*n);
+			return;
+		}
+		// a cell only worth it if one of its sub-cells yields something
+		if (visits % merge_visits == 0) {
+			bool dead { true };
+			for (size_t i { 0 } ; i < block_size && dead ; i++)
+				dead = child(block, i).success.load(std::memory_order_relaxed) == 0;
+			if (dead) {
+				merge(*n);
+				return;
+			}
+		}
+		if (p.empty())
+			return;
+		coordinate coord { p.front() };
+		p.pop();
+		n = &child(block, coord.first * layer_resolution + coord.second);
+	}
+}
 
-	root.feedback(p, success, total);
+double monte_carlo_tree::node::score(Int parent_total) const {
+	Int t { total.load(std::memory_order_relaxed) };
+	if (t == 0)
+		return std::numeric_limits<double>::infinity();
+	return static_cast<double>(success.load(std::memory_order_relaxed)) / t
+	     + std::sqrt(2. * std::log(static_cast<double>(std::max(parent_total, t))) / t);
 }
 
-bool monte_carlo_tree::node::has_children() const {
-	return !children.empty();
+void monte_carlo_tree::node::reset() {
+	success.store(0, std::memory_order_relaxed);
+	total.store(0, std::memory_order_relaxed);
+	visits.store(0, std::memory_order_relaxed);
+	first_child.store(no_children, std::memory_order_relaxed);
 }
 
-void monte_carlo_tree::node::sample(monte_carlo_tree::path& p) const {
-	if (!has_children())
-		return;
+uint32_t monte_carlo_tree::allocate_block() {
+	uint32_t block;
+	if (!free_blocks.empty()) {
+		block = free_blocks.back();
+		free_blocks.pop_back();
+	}
+	else if (allocated_blocks < max_blocks) {
+		block = ++allocated_blocks;
+		size_t chunk { (block - 1) / blocks_per_chunk };
+		if (!chunks[chunk])
+			chunks[chunk].reset(new node[blocks_per_chunk * block_size]);
+	}
+	else
+		return no_children;
+	for (size_t i { 0 } ; i < block_size ; i++)
+		child(block, i).reset();
+	used_blocks.fetch_add(1, std::memory_order_relaxed);
+	return block;
+}
 
-	auto it = std::max_element(children.begin(), children.end(), [](const auto& a, const auto& b){
-		return a.second.score() < b.second.score();
-	});
-	p.push(it->first);
-	children.at(it->first).sample(p);
-
-	// coordinate c = std::make_pair(0, 0);
-	// double best_score = children.at(c).score();
-	// for (const auto& e : children) {
-	// 	double score = e.second.score();
-	// 	if (score > best_score) {
-	// 		best_score = score;
-	// 		c = e.first;
-	// 	}
-	// }
-	// p.push(c);
-	// children.at(c).sample(p);
+void monte_carlo_tree::clear() {
+	root.reset();
+	// chunks are kept, their blocks are allocated again from the first one
+	allocated_blocks = 0;
+	free_blocks.clear();
+	used_blocks.store(0, std::memory_order_relaxed);
 }
 
-void monte_carlo_tree::node::feedback(path& p, Int success, Int total) {
-	rate.first += success;
-	rate.second += total;
-	if (p.empty())
+void monte_carlo_tree::split(node& n) {
+	std::unique_lock<std::mutex> lock(structure_mutex, std::try_to_lock);
+	if (!lock.owns_lock() || n.first_child.load(std::memory_order_relaxed) != no_children)
 		return;
-	coordinate coord = p.front();
-	p.pop();
-	children.at(coord).feedback(p, success, total);
+
+	uint32_t block { allocate_block() };
+	if (block == no_children)
+		return; // memory cap reached
+	// publishes the reset children, and the chunk when it is new
+	n.first_child.store(block, std::memory_order_release);
 }
 
-double monte_carlo_tree::node::score() const {
-	if (rate.second == 0)
-		return std::numeric_limits<double>::infinity();
+void monte_carlo_tree::merge(node& n) {
+	std::unique_lock<std::mutex> lock(structure_mutex, std::try_to_lock);
+	if (!lock.owns_lock())
+		return;
 
-	double success = rate.first;
-	double local_total = rate.second;
-	double total = parent->rate.second;
-	return  success / local_total + std::sqrt(2. * std::log(total) / local_total );
+	// children are leaves, or dead cells whose own children are dead too
+	std::vector<node*> stack { &n };
+	while (!stack.empty()) {
+		node* m { stack.back() };
+		stack.pop_back();
+		uint32_t block { m->first_child.exchange(no_children, std::memory_order_relaxed) };
+		if (block == no_children)
+			continue;
+		for (size_t i { 0 } ; i < block_size ; i++)
+			stack.push_back(&child(block, i));
+		free_blocks.push_back(block);
+		used_blocks.fetch_sub(1, std::memory_order_relaxed);
+	}
+	// the cell yielded nothing since it was split: it has to yield again, and be visited again, to be split anew,
+	// otherwise its earlier success would split it at the next feedback
+	n.success.store(0, std::memory_order_relaxed);
+	n.visits.store(0, std::memory_order_relaxed);
 }
 
-monte_carlo_tree::node::node(monte_carlo_tree* root, node* parent, uint16_t layers, uint16_t layer_resolution) {
-	rate.first = 0;
-	rate.second = 0;
-	this->root = root;
-	this->parent = parent;
-
-	if (layers <= 0)
-		return;
+// Layout, in the host's byte order: "BBMCTREE" magic, format version, layers, layer resolution, then the nodes in
+// depth-first order, each followed by its children
+bool monte_carlo_tree::save(const std::string& path) const {
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.write(magic, sizeof(magic));
+	file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+	file.write(reinterpret_cast<const char*>(&layers), sizeof(layers));
+	file.write(reinterpret_cast<const char*>(&layer_resolution), sizeof(layer_resolution));
+
+	std::vector<const node*> stack { &root };
+	while (!stack.empty()) {
+		const node* n { stack.back() };
+		stack.pop_back();
+		uint32_t block { n->first_child.load(std::memory_order_relaxed) };
+		saved_node saved { n->success.load(std::memory_order_relaxed), n->total.load(std::memory_order_relaxed),
+		                   n->visits.load(std::memory_order_relaxed), block != no_children };
+		file.write(reinterpret_cast<const char*>(&saved), sizeof(saved));
+		// pushed backwards so that the first child is written first
+		for (size_t i { block_size } ; block != no_children && i-- > 0 ; )
+			stack.push_back(&child(block, i));
+	}
+	return static_cast<bool>(file.flush());
+}
 
-	for (size_t i = 0; i < layer_resolution; i++)
-		for (size_t j = 0; j < layer_resolution; j++)
-			children.insert(std::make_pair(std::make_pair(i, j), node(root, this, layers - 1, layer_resolution)));
-}
\ No newline at end of file
+bool monte_carlo_tree::load(const std::string& path, Real decay) {
+	std::ifstream file(path, std::ios::binary);
+	char file_magic[sizeof(magic)];
+	uint32_t file_version;
+	uint16_t file_layers, file_resolution;
+	file.read(file_magic, sizeof(file_magic));
+	file.read(reinterpret_cast<char*>(&file_version), sizeof(file_version));
+	file.read(reinterpret_cast<char*>(&file_layers), sizeof(file_layers));
+	file.read(reinterpret_cast<char*>(&file_resolution), sizeof(file_resolution));
+	if (!file || std::memcmp(file_magic, magic, sizeof(magic)) != 0 || file_version != version
+	||  file_layers != layers || file_resolution != layer_resolution)
+		return false;
+
+	std::lock_guard<std::mutex> lock(structure_mutex);
+	clear();
+	auto scaled = [decay](Int counter) { return static_cast<Int>(std::llround(counter * decay)); };
+	// nodes to read, with their depth. Children beyond the node cap are read into `skipped` and dropped
+	node skipped;
+	std::vector<std::pair<node*, uint16_t>> stack { { &root, 0 } };
+	while (!stack.empty()) {
+		auto [n, depth] = stack.back();
+		stack.pop_back();
+		saved_node saved;
+		if (!file.read(reinterpret_cast<char*>(&saved), sizeof(saved)) || saved.success > saved.total || (saved.has_children && depth >= layers)) {
+			clear();
+			return false;
+		}
+		if (n == &skipped) {
+			for (size_t i { 0 } ; saved.has_children && i < block_size ; i++)
+				stack.push_back({ &skipped, depth + 1 });
+			continue;
+		}
+		n->success.store(scaled(saved.success), std::memory_order_relaxed);
+		n->total.store(scaled(saved.total), std::memory_order_relaxed);
+		n->visits.store(static_cast<uint32_t>(saved.visits * decay), std::memory_order_relaxed);
+		if (!saved.has_children)
+			continue;
+		uint32_t block { allocate_block() };
+		n->first_child.store(block, std::memory_order_relaxed);
+		for (size_t i { block_size } ; i-- > 0 ; )
+			stack.push_back({ block == no_children ? &skipped : &child(block, i), depth + 1 });
+	}
+	return true;
+}
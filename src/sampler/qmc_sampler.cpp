@@ -0,0 +1,107 @@
+#include "sampler/qmc_sampler.h"
+
+#include <algorithm>
+
+#include "helper.h"
+
+namespace {
+	uint32_t reverse_bits(uint32_t x) {
+		x = ((x >> 1) & 0x55555555u) | ((x & 0x55555555u) << 1);
+		x = ((x >> 2) & 0x33333333u) | ((x & 0x33333333u) << 2);
+		x = ((x >> 4) & 0x0f0f0f0fu) | ((x & 0x0f0f0f0fu) << 4);
+		x = ((x >> 8) & 0x00ff00ffu) | ((x & 0x00ff00ffu) << 8);
+		return (x >> 16) | (x << 16);
+	}
+
+	uint64_t reverse_bits(uint64_t x) {
+		return (static_cast<uint64_t>(reverse_bits(static_cast<uint32_t>(x))) << 32) | reverse_bits(static_cast<uint32_t>(x >> 32));
+	}
+
+	// Owen scrambling of the bits of x, from "Practical Hash-based Owen Scrambling" (Burley, 2020)
+	uint32_t nested_uniform_scramble(uint32_t x, uint32_t seed) {
+		x = reverse_bits(x);
+		x += seed;
+		x ^= x * 0x6c50b47cu;
+		x ^= x * 0xb82f1e52u;
+		x ^= x * 0xc7afe638u;
+		x ^= x * 0x8d22f6e6u;
+		return reverse_bits(x);
+	}
+
+	// second dimension of the Sobol' sequence, whose direction numbers come from the polynomial x + 1
+	uint32_t sobol_y(uint32_t index) {
+		uint32_t res { 0 };
+		for (uint32_t v { 1u << 31 } ; index != 0 ; index >>= 1, v ^= v >> 1)
+			if (index & 1)
+				res ^= v;
+		return res;
+	}
+}
+
+qmc_sampler::qmc_sampler(std::complex<Real> corner_a, std::complex<Real> corner_b, qmc_sequence sequence, Int seed) :
+	sequence(sequence),
+	key(splitmix64(seed))
+{
+	auto [real_m, real_M] = minmax(corner_a.real(), corner_b.real());
+	auto [imag_m, imag_M] = minmax(corner_a.imag(), corner_b.imag());
+	this->corner_a = std::complex(real_m, imag_m);
+	this->corner_b = std::complex(real_M, imag_M);
+
+	// one random permutation of {0, 1, 2} per digit of the Halton sequence in base 3
+	for (int k { 0 } ; k < base3_digits ; k++) {
+		uint8_t* p { base3_permutations[k] };
+		p[0] = 0; p[1] = 1; p[2] = 2;
+		uint64_t h { splitmix64(key + k) };
+		std::swap(p[2], p[h % 3]);
+		std::swap(p[1], p[(h >> 32) % 2]);
+	}
+}
+
+// The sequence is 32 bits deep: every block of 2^32 indices is scrambled with its own seeds, and the bits below the
+// sequence's resolution are filled by a hash so that deep zooms do not see a lattice
+std::pair<Real, Real> qmc_sampler::sobol(Int index) const {
+	uint64_t block_key { splitmix64(key ^ (index >> 32)) };
+	uint32_t i { nested_uniform_scramble(static_cast<uint32_t>(index), static_cast<uint32_t>(block_key)) };
+	uint32_t x { nested_uniform_scramble(reverse_bits(i), static_cast<uint32_t>(block_key >> 32)) };
+	uint32_t y { nested_uniform_scramble(sobol_y(i), static_cast<uint32_t>(splitmix64(block_key))) };
+	uint64_t low_bits { splitmix64(key + index) };
+	return {
+		to_unit((static_cast<uint64_t>(x) << 32) | (low_bits & 0xffffffffu)),
+		to_unit((static_cast<uint64_t>(y) << 32) | (low_bits >> 32))
+	};
+}
+
+std::pair<Real, Real> qmc_sampler::halton(Int index) const {
+	// base 2: radical inverse by bit reversal, scrambled by a digital shift
+	Real x { to_unit(reverse_bits(static_cast<uint64_t>(index)) ^ key) };
+
+	// base 3: every digit, leading zeros included, goes through its permutation
+	Real y { 0. };
+	Real scale { 1. / 3. };
+	for (int k { 0 } ; k < base3_digits && scale > 0x1.0p-53 ; k++) {
+		y += base3_permutations[k][index % 3] * scale;
+		index /= 3;
+		scale /= 3.;
+	}
+	return { x, std::min(y, 1. - 0x1.0p-53) };
+}
+
+std::pair<Real, Real> qmc_sampler::r2(Int index) const {
+	// 2^64 / g and 2^64 / g^2, g being the plastic number, in fixed point so that the recurrence never loses precision
+	constexpr uint64_t alpha_x { 0xc13fa9a902a6328fu };
+	constexpr uint64_t alpha_y { 0x91e10da5c79e7b1du };
+	return {
+		to_unit(key + index * alpha_x),
+		to_unit(splitmix64(key) + index * alpha_y)
+	};
+}
+
+std::complex<Real> qmc_sampler::draw(Int index, Int& weight) {
+	auto [u, v] = sequence == qmc_sequence::Sobol  ? sobol(index)
+	            : sequence == qmc_sequence::Halton ? halton(index)
+	            :                                    r2(index);
+	Real real = corner_a.real() + u * (corner_b.real() - corner_a.real());
+	Real imag = corner_a.imag() + v * (corner_b.imag() - corner_a.imag());
+	weight = 1;
+	return std::complex(real, imag);
+}
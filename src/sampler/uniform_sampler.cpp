@@ -2,8 +2,12 @@
 
 #include "helper.h"
 
-uniform_sampler::uniform_sampler(std::complex<Real> corner_a, std::complex<Real> corner_b) {
-	engine = std::ranlux48(rd());
+uniform_sampler::uniform_sampler(std::complex<Real> corner_a, std::complex<Real> corner_b) :
+	uniform_sampler(corner_a, corner_b, std::random_device()())
+{}
+
+uniform_sampler::uniform_sampler(std::complex<Real> corner_a, std::complex<Real> corner_b, Int seed) {
+	engine = std::ranlux48(seed);
 
 	auto [real_m, real_M] = minmax(corner_a.real(), corner_b.real());
 	auto [imag_m, imag_M] = minmax(corner_a.imag(), corner_b.imag());
@@ -11,8 +15,9 @@ uniform_sampler::uniform_sampler(std::complex<Real> corner_a, std::complex<Real>
 	imag_distrib = std::uniform_real_distribution(imag_m, imag_M);
 }
 
-sample_result uniform_sampler::sample() {
+std::complex<Real> uniform_sampler::draw(Int, Int& weight) {
 	double real = real_distrib(engine);
 	double imag = imag_distrib(engine);
-	return sample_result{ std::complex(real, imag), nullptr, [](std::shared_ptr<void>, Int, Int){ return; } };
+	weight = 1;
+	return std::complex(real, imag);
 }
\ No newline at end of file